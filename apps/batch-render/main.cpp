@@ -0,0 +1,281 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <json/src/json.hpp>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <c2ba/scene/Scene.hpp>
+#include <c2ba/scene/SceneCamera.hpp>
+#include <c2ba/rendering/TileRenderer.hpp>
+#include <c2ba/rendering/ExrTileWriter.hpp>
+#include <c2ba/maths.hpp>
+#include <c2ba/utils.hpp>
+#include <c2ba/Trace.hpp>
+
+using namespace c2ba;
+using json = nlohmann::json;
+
+// A job file describes one render:
+//
+// {
+//     "scene": "path/to/scene.obj",
+//     "output": "path/to/image.exr", // .exr (color and AOVs in floats) or .png (sRGB color)
+//     "width": 1920, "height": 1080,
+//     "spp": 64, // Samples per pixel
+//     "integrator": "ao", // "ao" or "geometry"
+//     "camera": { "position": [ 0, 0, 5 ], "target": [ 0, 0, 0 ], "up": [ 0, 1, 0 ], "fovy": 70, "near": 0.01, "far": 100 },
+//     "aovs": [ "depth", "normal" ], // Names given by aovName(), EXR outputs only
+//     "exposure": 0, // In stops, PNG outputs only
+//     "threads": 0, // 0 for all cores
+//     "tileSize": 32, // 0 to keep the default
+//     "checkpoint": "path/to/render.checkpoint", // Optional, resumes the render if the file exists
+//     "streaming": false, // Render row of tiles by row of tiles to the EXR output without the framebuffer, for images that do not fit in memory
+//     "deterministic": false, "seed": 0, // Samples only depend on their pixel, their index and the seed: same image whatever the thread count and tile size
+//     "counters": "path/to/counters.json", // Optional, where to write the counters of the render threads, see RenderCounters
+//     "trace": "path/to/trace.json" // Optional, where to write a timeline of the job in the Chrome trace format, see Trace.hpp
+// }
+//
+// Only "scene" and "output" are required. Without a camera, the bounding sphere of the scene is framed.
+
+namespace
+{
+
+float3 getFloat3(const json & value, const char * key, const float3 & defaultValue)
+{
+    if (!value.count(key)) {
+        return defaultValue;
+    }
+    const auto & array = value.at(key);
+    return float3(array.at(0).get<float>(), array.at(1).get<float>(), array.at(2).get<float>());
+}
+
+struct Camera
+{
+    float4x4 viewMatrix;
+    float4x4 projMatrix;
+};
+
+Camera makeCamera(const json & job, const SceneGeometry & geometry, size_t width, size_t height)
+{
+    // Frame the bounding sphere of the scene by default
+    const auto sceneCamera = frameScene(geometry);
+    const auto center = sceneCamera.center;
+    const auto radius = sceneCamera.radius;
+
+    const auto camera = job.count("camera") ? job.at("camera") : json::object();
+    const auto position = getFloat3(camera, "position", center + float3(0.f, 0.f, 2.f * radius));
+    const auto target = getFloat3(camera, "target", center);
+    const auto up = getFloat3(camera, "up", float3(0.f, 1.f, 0.f));
+    const auto fovy = camera.value("fovy", 70.f);
+    const auto zNear = camera.value("near", 0.01f * radius);
+    const auto zFar = camera.value("far", 10.f * radius);
+
+    return{ glm::lookAt(position, target, up), glm::perspective(glm::radians(fovy), float(width) / height, zNear, zFar) };
+}
+
+AOVSet parseAOVs(const json & job)
+{
+    AOVSet aovs = 0;
+    if (!job.count("aovs")) {
+        return aovs;
+    }
+    for (const auto & name : job.at("aovs")) {
+        size_t aovIdx = 0;
+        while (aovIdx < AOVCount && name.get<std::string>() != aovName(AOV(aovIdx))) {
+            ++aovIdx;
+        }
+        if (aovIdx == AOVCount) {
+            throw std::runtime_error("Unknown AOV " + name.get<std::string>());
+        }
+        aovs |= aovBit(AOV(aovIdx));
+    }
+    return aovs;
+}
+
+bool hasExtension(const std::string & path, const std::string & extension)
+{
+    return path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+// Write the image of the renderer with its AOVs, rows of tiles by rows of tiles
+void writeExr(const std::string & path, const TileRenderer & renderer, size_t width, size_t height, size_t tileSize)
+{
+    std::vector<float4> pixels((const float4 *)renderer.getPixels(), (const float4 *)renderer.getPixels() + width * height);
+    for (auto & pixel : pixels) {
+        if (pixel.w > 0.f) {
+            pixel /= pixel.w;
+        }
+    }
+    flipRows(pixels.data(), width, height);
+
+    std::vector<float> aovs[AOVCount];
+    for (size_t aovIdx = 0; aovIdx < AOVCount; ++aovIdx) {
+        if (const auto aovPixels = renderer.getAOVPixels(AOV(aovIdx))) {
+            const auto componentCount = aovComponentCount(AOV(aovIdx));
+            aovs[aovIdx].assign(aovPixels, aovPixels + width * height * componentCount);
+            flipRows(aovs[aovIdx].data(), width * componentCount, height);
+        }
+    }
+
+    // The render is over: the OpenEXR pool can take as many cores as the render threads
+    ExrTileWriter writer(path, width, height, tileSize, renderer.aovs(), ExrCompression::Zip, renderer.batchThreadCount());
+    for (size_t tileY = 0; tileY < writer.tileCountY(); ++tileY) {
+        const auto beginY = tileY * tileSize;
+        AOVImages aovImages = {};
+        for (size_t aovIdx = 0; aovIdx < AOVCount; ++aovIdx) {
+            if (!aovs[aovIdx].empty()) {
+                aovImages[aovIdx] = aovs[aovIdx].data() + beginY * width * aovComponentCount(AOV(aovIdx));
+            }
+        }
+        writer.writeTileRow(tileY, pixels.data() + beginY * width, aovImages);
+    }
+}
+
+void writePng(const std::string & path, const TileRenderer & renderer, size_t width, size_t height)
+{
+    std::vector<uint32_t> pixels((const uint32_t *)renderer.getPixels(), (const uint32_t *)renderer.getPixels() + width * height);
+    flipRows(pixels.data(), width, height);
+    if (!stbi_write_png(path.c_str(), int(width), int(height), 4, pixels.data(), int(width * sizeof(uint32_t)))) {
+        throw std::runtime_error("Unable to write " + path);
+    }
+}
+
+int runJob(const std::string & jobPath)
+{
+    json job;
+    {
+        std::ifstream in(jobPath);
+        if (!in) {
+            std::cerr << "Unable to open job file " << jobPath << std::endl;
+            return -1;
+        }
+        in >> job;
+    }
+
+    const auto output = job.at("output").get<std::string>();
+    const auto isExr = hasExtension(output, ".exr");
+    if (!isExr && !hasExtension(output, ".png")) {
+        std::cerr << "Unsupported output format " << output << ", use .exr or .png" << std::endl;
+        return -1;
+    }
+    const auto isStreaming = job.value("streaming", false);
+    if (isStreaming && !isExr) {
+        std::cerr << "Streaming renders are only written to .exr outputs" << std::endl;
+        return -1;
+    }
+
+    const size_t width = job.value("width", 1280);
+    const size_t height = job.value("height", 720);
+    const size_t sampleCount = job.value("spp", 16);
+
+    const auto tracePath = job.value("trace", std::string());
+    if (!tracePath.empty()) {
+        startTracing();
+    }
+
+    Scene scene(loadModel(job.at("scene").get<std::string>()));
+    const auto camera = makeCamera(job, scene.geometry(), width, height);
+
+    TileRenderer renderer;
+    const auto integrator = job.value("integrator", std::string("ao"));
+    if (integrator == "geometry") {
+        renderer.setIntegrator(std::make_unique<GeometryIntegrator>());
+    }
+    else if (integrator != "ao") {
+        std::cerr << "Unknown integrator " << integrator << std::endl;
+        return -1;
+    }
+
+    renderer.setThreadCount(job.value("threads", 0u));
+    renderer.setTileSize(job.value("tileSize", 32u));
+    renderer.setAOVs(isExr ? parseAOVs(job) : 0);
+    renderer.setPixelFormat(isExr ? PixelFormat::RGBA32F : PixelFormat::RGBA8);
+    renderer.setExposure(job.value("exposure", 0.f));
+    renderer.setDeterministic(job.value("deterministic", false), job.value("seed", 0u));
+    if (!isStreaming) {
+        renderer.setFramebuffer(width, height); // Streaming renders have no framebuffer
+    }
+    renderer.setProjMatrix(camera.projMatrix);
+    renderer.setScene(scene);
+    renderer.setViewMatrix(camera.viewMatrix);
+
+    if (job.count("checkpoint") && !isStreaming) {
+        const auto checkpoint = job.at("checkpoint").get<std::string>();
+        if (!renderer.setCheckpoint(checkpoint)) {
+            std::cerr << "Unable to map checkpoint " << checkpoint << ", rendering without it" << std::endl;
+        }
+    }
+
+    std::cout << "Rendering " << jobPath << ": " << width << "x" << height << ", " << sampleCount << " spp" << std::endl;
+    const auto start = std::chrono::steady_clock::now();
+    if (isStreaming) {
+        renderer.renderToExr(output, width, height, sampleCount);
+    }
+    else {
+        renderer.renderSamples(sampleCount);
+    }
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered in " << seconds << " s, " << width * height * sampleCount / seconds * 1e-6 << " Msamples/s" << std::endl;
+
+    if (job.count("counters")) {
+        const auto countersPath = job.at("counters").get<std::string>();
+        std::ofstream out(countersPath);
+        if (!out) {
+            std::cerr << "Unable to write counters to " << countersPath << std::endl;
+            return -1;
+        }
+        renderer.counters().writeJson(out);
+    }
+
+    if (!tracePath.empty()) {
+        stopTracing();
+        if (!writeChromeTrace(tracePath)) {
+            std::cerr << "Unable to write trace to " << tracePath << std::endl;
+            return -1;
+        }
+    }
+
+    if (!isStreaming) {
+        if (isExr) {
+            writeExr(output, renderer, width, height, renderer.tileSize());
+        }
+        else {
+            writePng(output, renderer, width, height);
+        }
+    }
+    std::cout << "Written " << output << std::endl;
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage : " << argv[0] << " < job.json > [ job.json ... ]" << std::endl;
+        return -1;
+    }
+
+    for (int jobIdx = 1; jobIdx < argc; ++jobIdx)
+    {
+        try {
+            if (const auto exitCode = runJob(argv[jobIdx])) {
+                return exitCode;
+            }
+        }
+        catch (const std::exception & e) {
+            std::cerr << "Job " << argv[jobIdx] << " failed: " << e.what() << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
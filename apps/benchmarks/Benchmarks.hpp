@@ -0,0 +1,66 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+
+// A benchmark receives the command line arguments following its name and returns the exit code of the application
+using BenchmarkFunction = int(*)(int argc, char** argv);
+
+using Clock = std::chrono::high_resolution_clock;
+
+inline double microseconds(Clock::duration d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+template<typename Functor>
+inline double measureMicroseconds(Functor && f)
+{
+    const auto start = Clock::now();
+    f();
+    return microseconds(Clock::now() - start);
+}
+
+// Read an optional numeric argument, or return a default value
+inline size_t getArg(int argc, char** argv, int index, size_t defaultValue)
+{
+    return index < argc ? std::stoul(argv[index]) : defaultValue;
+}
+
+inline double median(std::vector<double> values)
+{
+    if (values.empty())
+        return 0.;
+    const auto middle = begin(values) + values.size() / 2;
+    std::nth_element(begin(values), middle, end(values));
+    return *middle;
+}
+
+inline double mean(const std::vector<double> & values)
+{
+    return values.empty() ? 0. : std::accumulate(begin(values), end(values), 0.) / values.size();
+}
+
+// Results are printed one per line as "<benchmark> <key>=<value> ... <metric> <value> <unit>" to be easily parsed by scripts
+inline void printResult(const std::string & benchmark, const std::string & config, const std::string & metric, double value, const std::string & unit)
+{
+    std::cout << benchmark << " " << config << " " << metric << " " << value << " " << unit << std::endl;
+}
+
+int benchmarkTaskLaunch(int argc, char** argv);
+
+int benchmarkParallelLoop(int argc, char** argv);
+
+int benchmarkFirstTile(int argc, char** argv);
+
+int benchmarkFramebufferStorage(int argc, char** argv);
+
+int benchmarkPixelLayout(int argc, char** argv);
+
+int benchmarkRayThroughput(int argc, char** argv);
+
+int benchmarkKernels(int argc, char** argv);
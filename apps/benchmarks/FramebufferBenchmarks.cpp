@@ -0,0 +1,84 @@
+#include <sstream>
+#include <random>
+
+#include <c2ba/rendering/TiledFramebuffer.hpp>
+
+#include "Benchmarks.hpp"
+
+using namespace c2ba;
+
+namespace
+{
+
+// Add one random sample per pixel to every tile, as a render pass would do
+template<typename TileStorage>
+void accumulatePass(BasicTiledFramebuffer<TileStorage> & framebuffer, std::vector<float4> & scratch, std::mt19937 & rng)
+{
+    std::uniform_real_distribution<float> distribution(0.f, 4.f);
+    for (size_t tileIdx = 0; tileIdx < framebuffer.tileCount(); ++tileIdx)
+    {
+        const auto pixels = framebuffer.loadTile(tileIdx, scratch.data());
+        const auto bounds = framebuffer.tileBounds(tileIdx);
+        for (size_t y = 0; y < bounds.countY; ++y) {
+            for (size_t x = 0; x < bounds.countX; ++x) {
+                pixels[x + y * bounds.countX] += float4(distribution(rng), distribution(rng), distribution(rng), 1.f);
+            }
+        }
+        framebuffer.storeTile(tileIdx, pixels);
+        framebuffer.commitTile(tileIdx);
+    }
+}
+
+template<typename TileStorage>
+void benchmarkStorage(const std::string & storageName, size_t width, size_t height, size_t tileSize, size_t passCount)
+{
+    BasicTiledFramebuffer<TileStorage> framebuffer(tileSize, width, height);
+    std::vector<float4> scratch(framebuffer.tilePixelCount());
+    std::mt19937 rng(0);
+
+    for (size_t tileIdx = 0; tileIdx < framebuffer.tileCount(); ++tileIdx) {
+        framebuffer.acquireTile(tileIdx, 0);
+    }
+
+    std::vector<double> passTimes;
+    for (size_t i = 0; i < passCount; ++i) {
+        passTimes.emplace_back(measureMicroseconds([&]() { accumulatePass(framebuffer, scratch, rng); }));
+    }
+
+    std::vector<uint8_t> image(framebuffer.pixelCount() * sizeof(float4));
+    std::vector<double> copyFloatTimes, copyRGBA8Times;
+    for (size_t i = 0; i < passCount; ++i) {
+        copyFloatTimes.emplace_back(measureMicroseconds([&]() { framebuffer.copy(image.data(), 0, PixelFormat::RGBA32F); }));
+        copyRGBA8Times.emplace_back(measureMicroseconds([&]() { framebuffer.copy(image.data(), 0, PixelFormat::RGBA8); }));
+    }
+
+    std::ostringstream config;
+    config << "storage=" << storageName << " resolution=" << width << "x" << height << " tileSize=" << tileSize << " threads=" << getThreadCount();
+
+    const auto megaPixels = framebuffer.pixelCount() / 1e6;
+    printResult("framebuffer-storage", config.str(), "data_size", framebuffer.dataByteSize() / (1024. * 1024.), "MB");
+    printResult("framebuffer-storage", config.str(), "memory_size", framebuffer.memoryByteSize() / (1024. * 1024.), "MB");
+    printResult("framebuffer-storage", config.str(), "pass_median", median(passTimes) / 1000., "ms");
+    printResult("framebuffer-storage", config.str(), "copy_rgba32f_throughput", megaPixels / (median(copyFloatTimes) * 1e-6), "Mpixels/s");
+    printResult("framebuffer-storage", config.str(), "copy_rgba8_throughput", megaPixels / (median(copyRGBA8Times) * 1e-6), "Mpixels/s");
+}
+
+}
+
+// Arguments: [ width = 1920 ] [ height = 1080 ] [ tileSize = 32 ] [ passCount = 16 ]
+//
+// Compare the memory footprint and the accumulation and resolve costs of the storages of TiledFramebuffer.
+// Passes are run on the calling thread, resolves on the thread pool.
+int benchmarkFramebufferStorage(int argc, char** argv)
+{
+    const auto width = getArg(argc, argv, 0, 1920);
+    const auto height = getArg(argc, argv, 1, 1080);
+    const auto tileSize = getArg(argc, argv, 2, 32);
+    const auto passCount = getArg(argc, argv, 3, 16);
+
+    benchmarkStorage<Float4TileStorage>("float4", width, height, tileSize, passCount);
+    benchmarkStorage<HalfTileStorage>("half", width, height, tileSize, passCount);
+    benchmarkStorage<RGB9E5TileStorage>("rgb9e5", width, height, tileSize, passCount);
+
+    return 0;
+}
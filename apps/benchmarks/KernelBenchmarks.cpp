@@ -0,0 +1,314 @@
+#include <sstream>
+#include <random>
+#include <cstdint>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define C2BA_HAS_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define C2BA_HAS_RDTSC
+#endif
+
+#include <c2ba/scene/Scene.hpp>
+#include <c2ba/scene/SceneCamera.hpp>
+#include <c2ba/rendering/TiledFramebuffer.hpp>
+#include <c2ba/rendering/integrators/AOIntegrator.hpp>
+
+#include "Benchmarks.hpp"
+
+using namespace c2ba;
+
+namespace
+{
+
+// Time stamp counter of the processor. On x86 it ticks at the nominal frequency whatever the current one, so cycles per operation
+// are reference cycles: they differ from core cycles when turbo or power saving states are active. 0 on other architectures.
+inline uint64_t readCycleCounter()
+{
+#ifdef C2BA_HAS_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Results of the kernels end here so that the compiler cannot drop the computations
+volatile float s_Sink;
+
+// Run a kernel repeatCount times after a warm up run, and print the median cost of one operation.
+//
+// \arg config Name and variant of the kernel, as "key=value" pairs
+// \arg kernel Functor running opCount operations on inputs prepared beforehand, returning a value depending on all their results
+template<typename Kernel>
+void measureKernel(const std::string & config, size_t opCount, size_t repeatCount, Kernel && kernel)
+{
+    s_Sink = kernel();
+
+    std::vector<double> times, cycles;
+    for (size_t repeatIdx = 0; repeatIdx < repeatCount; ++repeatIdx)
+    {
+        uint64_t cycleCount = 0;
+        times.emplace_back(measureMicroseconds([&]()
+        {
+            const auto start = readCycleCounter();
+            s_Sink = kernel();
+            cycleCount = readCycleCounter() - start;
+        }));
+        cycles.emplace_back(double(cycleCount));
+    }
+
+    printResult("kernels", config, "time", median(times) * 1000. / opCount, "ns/op");
+    printResult("kernels", config, "cycles", median(cycles) / opCount, "cycles/op");
+}
+
+std::vector<float2> randomSamples(size_t count, std::mt19937 & rng)
+{
+    std::uniform_real_distribution<float> distribution(0.f, 1.f);
+    std::vector<float2> samples(count);
+    for (auto & sample : samples) {
+        sample = float2(distribution(rng), distribution(rng));
+    }
+    return samples;
+}
+
+void benchmarkMathsKernels(size_t opCount, size_t repeatCount, std::mt19937 & rng)
+{
+    const auto samples = randomSamples(opCount, rng);
+
+    measureKernel("kernel=sampleHemisphereCosine variant=scalar", opCount, repeatCount, [&]()
+    {
+        float sum = 0.f;
+        for (const auto & sample : samples) {
+            const auto dir = sampleHemisphereCosine(sample.x, sample.y);
+            sum += dir.x + dir.y + dir.z;
+        }
+        return sum;
+    });
+
+    std::vector<float3> normals;
+    for (const auto & sample : samples) {
+        // Uniform directions on the sphere, both hemispheres to exercise the sign of makeOrthonormals()
+        const auto z = 2.f * sample.x - 1.f;
+        const auto r = sqrt(std::max(0.f, 1.f - z * z));
+        const auto phi = 2.f * pi<float>() * sample.y;
+        normals.emplace_back(r * cos(phi), r * sin(phi), z);
+    }
+
+    measureKernel("kernel=makeOrthonormals variant=scalar", opCount, repeatCount, [&]()
+    {
+        float sum = 0.f;
+        for (const auto & N : normals) {
+            float3 Tx, Ty;
+            makeOrthonormals(N, Tx, Ty);
+            sum += Tx.x + Ty.y;
+        }
+        return sum;
+    });
+}
+
+void benchmarkPrimaryRay(const float4x4 & projMatrix, const float4x4 & viewMatrix, size_t width, size_t height, size_t repeatCount, std::mt19937 & rng)
+{
+    static const size_t tileSize = 32;
+
+    AOIntegrator integrator;
+    integrator.setFramebufferSize(width, height);
+    integrator.setTileSize(tileSize);
+
+    const Integrator::Camera camera{ inverse(projMatrix), inverse(viewMatrix) };
+    const auto samples = randomSamples(tileSize * tileSize, rng);
+
+    for (const auto layout : { TilePixelLayout::RowMajor, TilePixelLayout::Morton })
+    {
+        const TiledFramebuffer framebuffer(tileSize, width, height, layout);
+
+        std::vector<Integrator::RenderTileParams> tiles(framebuffer.tileCount());
+        for (size_t tileIdx = 0; tileIdx < tiles.size(); ++tileIdx)
+        {
+            const auto bounds = framebuffer.tileBounds(tileIdx);
+            auto & params = tiles[tileIdx];
+            params = Integrator::RenderTileParams{};
+            params.tileId = tileIdx;
+            params.beginX = bounds.beginX;
+            params.beginY = bounds.beginY;
+            params.countX = bounds.countX;
+            params.countY = bounds.countY;
+            params.beginPixel = 0;
+            params.endPixel = bounds.countX * bounds.countY;
+            params.pixelCoords = framebuffer.tilePixelCoords(tileIdx);
+            params.camera = &camera;
+        }
+
+        std::ostringstream config;
+        config << "kernel=AOIntegrator::primaryRay variant=scalar layout=" << (layout == TilePixelLayout::Morton ? "morton" : "row-major")
+            << " resolution=" << width << "x" << height;
+
+        measureKernel(config.str(), width * height, repeatCount, [&]()
+        {
+            float sum = 0.f;
+            for (const auto & params : tiles) {
+                for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId) {
+                    const auto ray = integrator.primaryRay(pixelId, samples[pixelId], params);
+                    sum += ray.dir.x + ray.dir.y;
+                }
+            }
+            return sum;
+        });
+    }
+}
+
+void benchmarkEvalHitPoint(const Scene & scene, const float4x4 & projMatrix, const float4x4 & viewMatrix, size_t width, size_t height, size_t repeatCount)
+{
+    // Primary hits through pixel centers
+    const auto rcpProjMatrix = inverse(projMatrix);
+    const auto rcpViewMatrix = inverse(viewMatrix);
+    const auto viewOrigin = float3(rcpViewMatrix[3]);
+
+    std::vector<Ray> rays;
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            const auto ndcPos = float2(-1.f) + 2.f * float2(x + 0.5f, y + 0.5f) / float2(width, height);
+            const auto viewSpacePos = divideW<float4>(rcpProjMatrix * float4(ndcPos, -1.f, 1.f));
+            const auto worldSpacePos = divideW<float3>(rcpViewMatrix * viewSpacePos);
+            rays.emplace_back(viewOrigin, worldSpacePos - viewOrigin);
+        }
+    }
+    scene.intersect(rays.data(), rays.size(), RayProperties::Coherent);
+    rays.erase(std::remove_if(begin(rays), end(rays), [](const Ray & ray) { return ray.geomID == Ray::InvalidID; }), end(rays));
+
+    if (rays.empty()) {
+        std::cerr << "No primary hit, skipping Scene::evalHitPoint" << std::endl;
+        return;
+    }
+
+    measureKernel("kernel=Scene::evalHitPoint variant=Normal", rays.size(), repeatCount, [&]()
+    {
+        float sum = 0.f;
+        for (const auto & ray : rays) {
+            float3 N;
+            scene.evalHitPoint(ray, Normal(N));
+            sum += N.x;
+        }
+        return sum;
+    });
+
+    measureKernel("kernel=Scene::evalHitPoint variant=Normal+TriangleFacing", rays.size(), repeatCount, [&]()
+    {
+        float sum = 0.f;
+        for (const auto & ray : rays) {
+            float3 N;
+            Facing facing;
+            scene.evalHitPoint(ray, Normal(N), TriangleFacing(facing));
+            sum += facing == Facing::Front ? N.x : N.y;
+        }
+        return sum;
+    });
+}
+
+const char * pixelFormatName(PixelFormat format)
+{
+    static const char * names[] = { "rgba32f", "rgba8", "rgb10a2" };
+    return names[size_t(format)];
+}
+
+const PixelFormat s_PixelFormats[] = { PixelFormat::RGBA32F, PixelFormat::RGBA8, PixelFormat::RGB10A2 };
+
+void benchmarkConvertPixels(size_t opCount, size_t repeatCount, std::mt19937 & rng)
+{
+    std::uniform_real_distribution<float> distribution(0.f, 4.f);
+    std::vector<float4> pixels(opCount);
+    for (auto & pixel : pixels) {
+        pixel = float4(distribution(rng), distribution(rng), distribution(rng), std::floor(distribution(rng)));
+    }
+    std::vector<float4> outPixels(opCount);
+
+    for (const auto format : s_PixelFormats)
+    {
+        // convertPixels() takes its SSE2 path when the library is built with SSE2
+        for (const auto isScalar : { true, false })
+        {
+            std::ostringstream config;
+            config << "kernel=convertPixels variant=" << (isScalar ? "scalar" : "simd") << " format=" << pixelFormatName(format);
+
+            measureKernel(config.str(), opCount, repeatCount, [&]()
+            {
+                (isScalar ? convertPixelsScalar : convertPixels)(pixels.data(), opCount, format, 1.f, outPixels.data());
+                return outPixels[opCount / 2].x;
+            });
+        }
+    }
+}
+
+template<typename TileStorage>
+void benchmarkFramebufferCopy(const std::string & storageName, size_t width, size_t height, size_t repeatCount, std::mt19937 & rng)
+{
+    static const size_t tileSize = 32;
+
+    BasicTiledFramebuffer<TileStorage> framebuffer(tileSize, width, height);
+    std::vector<float4> scratch(framebuffer.tilePixelCount());
+    std::uniform_real_distribution<float> distribution(0.f, 4.f);
+    for (size_t tileIdx = 0; tileIdx < framebuffer.tileCount(); ++tileIdx)
+    {
+        framebuffer.acquireTile(tileIdx, 0);
+        const auto pixels = framebuffer.loadTile(tileIdx, scratch.data());
+        for (size_t pixelIdx = 0; pixelIdx < framebuffer.tilePixelCount(); ++pixelIdx) {
+            pixels[pixelIdx] += float4(distribution(rng), distribution(rng), distribution(rng), 1.f);
+        }
+        framebuffer.storeTile(tileIdx, pixels);
+        framebuffer.commitTile(tileIdx);
+    }
+
+    std::vector<float4> image(framebuffer.pixelCount());
+    for (const auto format : s_PixelFormats)
+    {
+        std::ostringstream config;
+        config << "kernel=TiledFramebuffer::copy variant=" << storageName << " format=" << pixelFormatName(format)
+            << " resolution=" << width << "x" << height << " threads=" << getThreadCount();
+
+        measureKernel(config.str(), framebuffer.pixelCount(), repeatCount, [&]()
+        {
+            framebuffer.copy(image.data(), 0, format);
+            return image[image.size() / 2].x;
+        });
+    }
+}
+
+}
+
+// Arguments: < path_to_scene > [ repeatCount = 21 ] [ opCount = 65536 ]
+//
+// Measure the cost of the per sample kernels of the renderer, one at a time on inputs prepared beforehand, in ns and cycles per operation.
+// An operation is one call of the kernel, or one pixel for pixel conversions and framebuffer copies. Kernels run on the calling thread,
+// except TiledFramebuffer::copy() which runs on the thread pool as in the renderer.
+int benchmarkKernels(int argc, char** argv)
+{
+    if (argc < 1)
+    {
+        std::cerr << "Usage : kernels < path_to_scene > [ repeatCount ] [ opCount ]" << std::endl;
+        return -1;
+    }
+
+    const auto repeatCount = getArg(argc, argv, 1, 21);
+    const auto opCount = getArg(argc, argv, 2, 65536);
+
+    // Images of about opCount pixels for the kernels working on pixels
+    const auto height = std::max(size_t(sqrt(opCount * 9. / 16.)), size_t(1));
+    const auto width = std::max(opCount / height, size_t(1));
+
+    Scene scene(loadModel(argv[0]));
+    const auto camera = frameScene(scene.geometry());
+    const auto projMatrix = sceneProjMatrix(camera, width, height);
+    const auto viewMatrix = orbitViewMatrix(camera, 0.f);
+
+    std::mt19937 rng(0);
+
+    benchmarkMathsKernels(opCount, repeatCount, rng);
+    benchmarkPrimaryRay(projMatrix, viewMatrix, width, height, repeatCount, rng);
+    benchmarkEvalHitPoint(scene, projMatrix, viewMatrix, width, height, repeatCount);
+    benchmarkConvertPixels(opCount, repeatCount, rng);
+    benchmarkFramebufferCopy<Float4TileStorage>("float4", width, height, repeatCount, rng);
+    benchmarkFramebufferCopy<HalfTileStorage>("half", width, height, repeatCount, rng);
+    benchmarkFramebufferCopy<RGB9E5TileStorage>("rgb9e5", width, height, repeatCount, rng);
+
+    return 0;
+}
@@ -0,0 +1,282 @@
+#include <sstream>
+#include <cstring>
+#include <memory>
+
+#include <c2ba/scene/Scene.hpp>
+#include <c2ba/scene/SceneCamera.hpp>
+#include <c2ba/rendering/TileRenderer.hpp>
+#include <c2ba/threads.hpp>
+
+#include "Benchmarks.hpp"
+
+using namespace c2ba;
+
+namespace
+{
+
+enum class KernelAPI
+{
+    Single, // rtcIntersect / rtcOccluded, one call per ray
+    Stream, // rtcIntersectNM / rtcOccludedNM on Ray structures, one call per tile
+    Packet4, // rtcIntersectNM / rtcOccludedNM on SOA packets, one call per tile
+    Packet8,
+    Packet16
+};
+
+const char * kernelAPIName(KernelAPI api)
+{
+    static const char * names[] = { "single", "stream", "soa4", "soa8", "soa16" };
+    return names[size_t(api)];
+}
+
+const char * rayAPIName(AOIntegrator::RayAPI api)
+{
+    static const char * names[] = { "single", "stream", "stream_soa" };
+    return names[size_t(api)];
+}
+
+// Copy rays to SOA packets, lanes past the last ray are inactive
+template<size_t N>
+void packRays(const Ray * rays, size_t count, std::vector<RaySOA<N>> & packets)
+{
+    packets.resize((count + N - 1) / N);
+    std::memset(packets.data(), 0, packets.size() * sizeof(RaySOA<N>));
+    for (size_t rayIdx = 0; rayIdx < packets.size() * N; ++rayIdx)
+    {
+        auto & packet = packets[rayIdx / N];
+        const auto lane = rayIdx % N;
+        packet.geomID[lane] = packet.primID[lane] = packet.instID[lane] = Ray::InvalidID;
+        packet.mask[lane] = 0xFFFFFFFF;
+        if (rayIdx >= count) {
+            packet.tnear[lane] = 1.f;
+            packet.tfar[lane] = 0.f;
+            continue;
+        }
+        const auto & ray = rays[rayIdx];
+        packet.orgx[lane] = ray.org.x;
+        packet.orgy[lane] = ray.org.y;
+        packet.orgz[lane] = ray.org.z;
+        packet.dirx[lane] = ray.dir.x;
+        packet.diry[lane] = ray.dir.y;
+        packet.dirz[lane] = ray.dir.z;
+        packet.tnear[lane] = ray.tnear;
+        packet.tfar[lane] = ray.tfar;
+    }
+}
+
+// Per thread buffers of the kernel benchmark
+struct KernelBuffers
+{
+    std::vector<Ray> rays;
+    std::vector<Ray> aoRays;
+    std::vector<Ray> tracedRays;
+    std::vector<RaySOA<4>> packets4;
+    std::vector<RaySOA<8>> packets8;
+    std::vector<RaySOA<16>> packets16;
+};
+
+// Trace rays with an API. Only the trace calls are timed: rays are copied to the layout of the API before.
+//
+// \return The time spent in the trace calls, in microseconds
+double traceRays(const Scene & scene, KernelAPI api, bool occlusion, const std::vector<Ray> & rays, size_t count, KernelBuffers & buffers)
+{
+    switch (api) {
+    case KernelAPI::Single:
+    case KernelAPI::Stream:
+        buffers.tracedRays.assign(begin(rays), begin(rays) + count);
+        return measureMicroseconds([&]()
+        {
+            if (api == KernelAPI::Stream) {
+                occlusion ? scene.occluded(buffers.tracedRays.data(), count, RayProperties::Coherent) : scene.intersect(buffers.tracedRays.data(), count, RayProperties::Coherent);
+                return;
+            }
+            for (auto & ray : buffers.tracedRays) {
+                occlusion ? scene.occluded(ray) : scene.intersect(ray);
+            }
+        });
+    case KernelAPI::Packet4:
+        packRays(rays.data(), count, buffers.packets4);
+        return measureMicroseconds([&]()
+        {
+            occlusion ? scene.occluded(buffers.packets4.data(), buffers.packets4.size(), RayProperties::Coherent) : scene.intersect(buffers.packets4.data(), buffers.packets4.size(), RayProperties::Coherent);
+        });
+    case KernelAPI::Packet8:
+        packRays(rays.data(), count, buffers.packets8);
+        return measureMicroseconds([&]()
+        {
+            occlusion ? scene.occluded(buffers.packets8.data(), buffers.packets8.size(), RayProperties::Coherent) : scene.intersect(buffers.packets8.data(), buffers.packets8.size(), RayProperties::Coherent);
+        });
+    default:
+        packRays(rays.data(), count, buffers.packets16);
+        return measureMicroseconds([&]()
+        {
+            occlusion ? scene.occluded(buffers.packets16.data(), buffers.packets16.size(), RayProperties::Coherent) : scene.intersect(buffers.packets16.data(), buffers.packets16.size(), RayProperties::Coherent);
+        });
+    }
+}
+
+struct RayThroughput
+{
+    double primaryRaysPerSecond; // In Mrays/s, summed over threads
+    double aoRaysPerSecond;
+};
+
+// Trace the primary rays and the ambient occlusion rays of each tile of an image with an API, tiles being distributed to threads.
+// Rays go through pixel centers and ambient occlusion rays use the same stratified directions for all pixels, so that all APIs trace the same rays.
+// Each thread times its own trace calls: the throughput of the threads are summed.
+RayThroughput measureRayThroughput(const Scene & scene, const float4x4 & projMatrix, const float4x4 & viewMatrix,
+    size_t width, size_t height, size_t tileSize, uint32_t threadCount, KernelAPI api, size_t repeatCount)
+{
+    static const size_t aoRaySqrtCount = 4;
+
+    const TiledFramebuffer framebuffer(tileSize, width, height);
+    const auto rcpProjMatrix = inverse(projMatrix);
+    const auto rcpViewMatrix = inverse(viewMatrix);
+    const auto viewOrigin = float3(rcpViewMatrix[3]);
+
+    std::vector<float3> aoDirections;
+    for (size_t j = 0; j < aoRaySqrtCount; ++j) {
+        for (size_t i = 0; i < aoRaySqrtCount; ++i) {
+            aoDirections.emplace_back(sampleHemisphereCosine((i + 0.5f) / aoRaySqrtCount, (j + 0.5f) / aoRaySqrtCount));
+        }
+    }
+
+    struct ThreadCounters
+    {
+        double primaryTime, aoTime;
+        size_t primaryRayCount, aoRayCount;
+    };
+
+    std::vector<double> primaryThroughputs, aoThroughputs;
+    for (size_t repeatIdx = 0; repeatIdx < repeatCount; ++repeatIdx)
+    {
+        std::vector<ThreadCounters> counters(threadCount, ThreadCounters{});
+
+        syncParallelLoop<KernelBuffers>(uint32_t(framebuffer.tileCount()), ParallelLoopOptions{ ParallelSchedule::Dynamic, 1, threadCount },
+            [&](uint32_t tileIdx, uint32_t threadId, KernelBuffers & buffers)
+        {
+            auto & threadCounters = counters[threadId];
+            const auto bounds = framebuffer.tileBounds(tileIdx);
+            const auto count = bounds.countX * bounds.countY;
+
+            buffers.rays.resize(count);
+            for (size_t pixelIdx = 0; pixelIdx < count; ++pixelIdx)
+            {
+                const auto rasterPos = float2(bounds.beginX + pixelIdx % bounds.countX + 0.5f, bounds.beginY + pixelIdx / bounds.countX + 0.5f);
+                const auto ndcPos = float2(-1.f) + 2.f * rasterPos / float2(width, height);
+                const auto viewSpacePos = divideW<float4>(rcpProjMatrix * float4(ndcPos, -1.f, 1.f));
+                const auto worldSpacePos = divideW<float3>(rcpViewMatrix * viewSpacePos);
+                buffers.rays[pixelIdx] = Ray{ viewOrigin, worldSpacePos - viewOrigin };
+            }
+            threadCounters.primaryTime += traceRays(scene, api, false, buffers.rays, count, buffers);
+            threadCounters.primaryRayCount += count;
+
+            // Hits are taken from a stream trace, whatever the API
+            scene.intersect(buffers.rays.data(), count, RayProperties::Coherent);
+            buffers.aoRays.clear();
+            for (size_t pixelIdx = 0; pixelIdx < count; ++pixelIdx)
+            {
+                const auto & ray = buffers.rays[pixelIdx];
+                if (ray.geomID == Ray::InvalidID) {
+                    continue;
+                }
+                float3 N;
+                scene.evalHitPoint(ray, Normal(N));
+                float3 Tx, Ty;
+                makeOrthonormals(N, Tx, Ty);
+                for (const auto & localDir : aoDirections) {
+                    buffers.aoRays.emplace_back(hitPoint(ray), localDir.x * Tx + localDir.y * Ty + localDir.z * N, 0.01f, 100.f);
+                }
+            }
+            threadCounters.aoTime += traceRays(scene, api, true, buffers.aoRays, buffers.aoRays.size(), buffers);
+            threadCounters.aoRayCount += buffers.aoRays.size();
+        });
+
+        double primaryThroughput = 0., aoThroughput = 0.;
+        for (const auto & threadCounters : counters) {
+            primaryThroughput += threadCounters.primaryTime > 0. ? threadCounters.primaryRayCount / threadCounters.primaryTime : 0.;
+            aoThroughput += threadCounters.aoTime > 0. ? threadCounters.aoRayCount / threadCounters.aoTime : 0.;
+        }
+        primaryThroughputs.emplace_back(primaryThroughput);
+        aoThroughputs.emplace_back(aoThroughput);
+    }
+
+    return{ median(primaryThroughputs), median(aoThroughputs) }; // In rays per microsecond, i.e. Mrays/s
+}
+
+// Thread counts from 1 to all threads of the pool, doubling
+std::vector<uint32_t> threadCounts()
+{
+    std::vector<uint32_t> counts;
+    for (uint32_t count = 1; count < getThreadCount(); count *= 2) {
+        counts.emplace_back(count);
+    }
+    counts.emplace_back(getThreadCount());
+    return counts;
+}
+
+}
+
+// Arguments: < path_to_scene > [ repeatCount = 5 ] [ width = 1280 ] [ height = 720 ] [ sampleCount = 4 ]
+//
+// Measure the ray throughput of the Embree APIs for primary and ambient occlusion rays, for each API, packet width, tile size and thread count.
+// Then measure the sample throughput of AOIntegrator with each of its ray APIs, for each tile size with all threads.
+int benchmarkRayThroughput(int argc, char** argv)
+{
+    if (argc < 1)
+    {
+        std::cerr << "Usage : ray-throughput < path_to_scene > [ repeatCount ] [ width ] [ height ] [ sampleCount ]" << std::endl;
+        return -1;
+    }
+
+    const auto repeatCount = getArg(argc, argv, 1, 5);
+    const auto width = getArg(argc, argv, 2, 1280);
+    const auto height = getArg(argc, argv, 3, 720);
+    const auto sampleCount = getArg(argc, argv, 4, 4);
+
+    Scene scene(loadModel(argv[0]));
+
+    const auto camera = frameScene(scene.geometry());
+    const auto projMatrix = sceneProjMatrix(camera, width, height);
+    const auto viewMatrix = orbitViewMatrix(camera, 0.f);
+
+    const size_t tileSizes[] = { 8, 16, 32, 64 };
+
+    for (const auto api : { KernelAPI::Single, KernelAPI::Stream, KernelAPI::Packet4, KernelAPI::Packet8, KernelAPI::Packet16 }) {
+        for (const auto tileSize : tileSizes) {
+            for (const auto threadCount : threadCounts()) {
+                const auto throughput = measureRayThroughput(scene, projMatrix, viewMatrix, width, height, tileSize, threadCount, api, repeatCount);
+
+                std::ostringstream config;
+                config << "api=" << kernelAPIName(api) << " tile=" << tileSize << " threads=" << threadCount << " resolution=" << width << "x" << height;
+                printResult("ray-throughput", config.str(), "primary", throughput.primaryRaysPerSecond, "Mrays/s");
+                printResult("ray-throughput", config.str(), "occlusion", throughput.aoRaysPerSecond, "Mrays/s");
+            }
+        }
+    }
+
+    for (const auto api : { AOIntegrator::RayAPI::Single, AOIntegrator::RayAPI::Stream, AOIntegrator::RayAPI::StreamSOA }) {
+        for (const auto tileSize : tileSizes) {
+            TileRenderer renderer;
+            auto integrator = std::make_unique<AOIntegrator>();
+            integrator->setRayAPI(api);
+            renderer.setIntegrator(std::move(integrator));
+            renderer.setTileSize(tileSize);
+            renderer.setFramebuffer(width, height);
+            renderer.setProjMatrix(projMatrix);
+            renderer.setScene(scene);
+            renderer.setViewMatrix(viewMatrix);
+
+            std::vector<double> times;
+            for (size_t repeatIdx = 0; repeatIdx < repeatCount; ++repeatIdx) {
+                times.emplace_back(measureMicroseconds([&]() { renderer.renderSamples(sampleCount); }));
+            }
+
+            std::ostringstream config;
+            config << "integrator=ao api=" << rayAPIName(api) << " tile=" << tileSize << " threads=" << getThreadCount() << " resolution=" << width << "x" << height;
+            printResult("ray-throughput", config.str(), "samples", width * height * sampleCount / median(times), "Msamples/s");
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <sstream>
+
+#include <c2ba/scene/Scene.hpp>
+#include <c2ba/scene/SceneCamera.hpp>
+#include <c2ba/rendering/TileRenderer.hpp>
+
+#include "Benchmarks.hpp"
+
+using namespace c2ba;
+
+// Arguments: < path_to_scene > [ repeatCount = 100 ] [ width = 1280 ] [ height = 720 ]
+//
+// Measure the time between a camera change and the first tile rendered with the new camera, as seen by an interactive application
+// that calls bake() after the change.
+int benchmarkFirstTile(int argc, char** argv)
+{
+    if (argc < 1)
+    {
+        std::cerr << "Usage : first-tile < path_to_scene > [ repeatCount ] [ width ] [ height ]" << std::endl;
+        return -1;
+    }
+
+    const auto repeatCount = getArg(argc, argv, 1, 100);
+    const auto width = getArg(argc, argv, 2, 1280);
+    const auto height = getArg(argc, argv, 3, 720);
+
+    Scene scene(loadModel(argv[0]));
+    const auto camera = frameScene(scene.geometry());
+
+    TileRenderer renderer;
+    renderer.setFramebuffer(width, height);
+    renderer.setProjMatrix(sceneProjMatrix(camera, width, height));
+    renderer.setScene(scene);
+    renderer.setViewMatrix(orbitViewMatrix(camera, 0.f));
+    renderer.start();
+    renderer.bake();
+
+    std::vector<double> bakeTimes, firstTileTimes;
+    for (size_t i = 0; i < repeatCount; ++i)
+    {
+        // Let the renderer work as it would between two camera moves
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        const auto viewMatrix = orbitViewMatrix(camera, 0.05f * (i + 1));
+
+        const auto start = Clock::now();
+        renderer.setViewMatrix(viewMatrix);
+        renderer.bake();
+        const auto bakeEnd = Clock::now();
+        while (renderer.renderedTileCount() == 0) {
+            std::this_thread::yield();
+        }
+        const auto firstTile = Clock::now();
+
+        bakeTimes.emplace_back(microseconds(bakeEnd - start));
+        firstTileTimes.emplace_back(microseconds(firstTile - start));
+    }
+
+    renderer.stop();
+
+    std::ostringstream config;
+    config << "resolution=" << width << "x" << height << " threads=" << getThreadCount();
+
+    printResult("first-tile", config.str(), "bake_median", median(bakeTimes) / 1000., "ms");
+    printResult("first-tile", config.str(), "bake_mean", mean(bakeTimes) / 1000., "ms");
+    printResult("first-tile", config.str(), "first_tile_median", median(firstTileTimes) / 1000., "ms");
+    printResult("first-tile", config.str(), "first_tile_mean", mean(firstTileTimes) / 1000., "ms");
+
+    return 0;
+}
+
+namespace
+{
+
+struct LayoutThroughput
+{
+    double primaryRaysPerSecond;
+    double aoRaysPerSecond;
+};
+
+// Trace the primary rays and the ambient occlusion rays of each tile of an image, one stream per tile in the pixel order of the layout.
+// Rays go through pixel centers and ambient occlusion rays use the same stratified directions for all pixels,
+// so that all layouts trace the same rays.
+LayoutThroughput measureLayoutThroughput(const Scene & scene, const float4x4 & projMatrix, const float4x4 & viewMatrix,
+    size_t width, size_t height, size_t tileSize, TilePixelLayout layout, size_t repeatCount)
+{
+    static const size_t aoRaySqrtCount = 4;
+    static const size_t aoRayCount = aoRaySqrtCount * aoRaySqrtCount;
+
+    const TiledFramebuffer framebuffer(tileSize, width, height, layout);
+    const auto rcpProjMatrix = inverse(projMatrix);
+    const auto rcpViewMatrix = inverse(viewMatrix);
+    const auto viewOrigin = float3(rcpViewMatrix[3]);
+
+    std::vector<float3> aoDirections;
+    for (size_t j = 0; j < aoRaySqrtCount; ++j) {
+        for (size_t i = 0; i < aoRaySqrtCount; ++i) {
+            aoDirections.emplace_back(sampleHemisphereCosine((i + 0.5f) / aoRaySqrtCount, (j + 0.5f) / aoRaySqrtCount));
+        }
+    }
+
+    std::vector<Ray> rays(framebuffer.tilePixelCount());
+    std::vector<Ray> aoRays(framebuffer.tilePixelCount() * aoRayCount);
+
+    std::vector<double> primaryTimes, aoTimes;
+    size_t primaryRayCount = 0, tracedAORayCount = 0;
+    for (size_t repeatIdx = 0; repeatIdx < repeatCount; ++repeatIdx)
+    {
+        double primaryTime = 0., aoTime = 0.;
+        primaryRayCount = tracedAORayCount = 0;
+
+        for (size_t tileIdx = 0; tileIdx < framebuffer.tileCount(); ++tileIdx)
+        {
+            const auto bounds = framebuffer.tileBounds(tileIdx);
+            const auto pixelCoords = framebuffer.tilePixelCoords(tileIdx);
+            const auto count = bounds.countX * bounds.countY;
+
+            for (size_t pixelIdx = 0; pixelIdx < count; ++pixelIdx)
+            {
+                const auto x = pixelCoords ? pixelCoords[pixelIdx] & 0xFFFF : pixelIdx % bounds.countX;
+                const auto y = pixelCoords ? pixelCoords[pixelIdx] >> 16 : pixelIdx / bounds.countX;
+                const auto rasterPos = float2(bounds.beginX + x + 0.5f, bounds.beginY + y + 0.5f);
+                const auto ndcPos = float2(-1.f) + 2.f * rasterPos / float2(width, height);
+                const auto viewSpacePos = divideW<float4>(rcpProjMatrix * float4(ndcPos, -1.f, 1.f));
+                const auto worldSpacePos = divideW<float3>(rcpViewMatrix * viewSpacePos);
+                rays[pixelIdx] = Ray{ viewOrigin, worldSpacePos - viewOrigin };
+            }
+
+            primaryTime += measureMicroseconds([&]() { scene.intersect(rays.data(), count, RayProperties::Coherent); });
+            primaryRayCount += count;
+
+            size_t aoCount = 0;
+            for (size_t pixelIdx = 0; pixelIdx < count; ++pixelIdx)
+            {
+                const auto & ray = rays[pixelIdx];
+                if (ray.geomID == Ray::InvalidID) {
+                    continue;
+                }
+                float3 N;
+                scene.evalHitPoint(ray, Normal(N));
+                float3 Tx, Ty;
+                makeOrthonormals(N, Tx, Ty);
+                for (const auto & localDir : aoDirections) {
+                    aoRays[aoCount++] = Ray{ hitPoint(ray), localDir.x * Tx + localDir.y * Ty + localDir.z * N, 0.01f, 100.f };
+                }
+            }
+
+            aoTime += measureMicroseconds([&]() { scene.occluded(aoRays.data(), aoCount, RayProperties::Coherent); });
+            tracedAORayCount += aoCount;
+        }
+
+        primaryTimes.emplace_back(primaryTime);
+        aoTimes.emplace_back(aoTime);
+    }
+
+    return{ primaryRayCount / median(primaryTimes), tracedAORayCount / median(aoTimes) }; // In rays per microsecond, i.e. Mrays/s
+}
+
+}
+
+// Arguments: < path_to_scene > [ repeatCount = 10 ] [ width = 1280 ] [ height = 720 ] [ tileSize = 32 ]
+//
+// Compare the throughput of the ray streams of the tiles (rtcIntersectNM and rtcOccludedNM) with row major and Morton pixel orders.
+// Rays are traced by the calling thread.
+int benchmarkPixelLayout(int argc, char** argv)
+{
+    if (argc < 1)
+    {
+        std::cerr << "Usage : pixel-layout < path_to_scene > [ repeatCount ] [ width ] [ height ] [ tileSize ]" << std::endl;
+        return -1;
+    }
+
+    const auto repeatCount = getArg(argc, argv, 1, 10);
+    const auto width = getArg(argc, argv, 2, 1280);
+    const auto height = getArg(argc, argv, 3, 720);
+    const auto tileSize = getArg(argc, argv, 4, 32);
+
+    Scene scene(loadModel(argv[0]));
+    const auto camera = frameScene(scene.geometry());
+    const auto projMatrix = sceneProjMatrix(camera, width, height);
+    const auto viewMatrix = orbitViewMatrix(camera, 0.f);
+
+    for (const auto layout : { TilePixelLayout::RowMajor, TilePixelLayout::Morton })
+    {
+        const auto throughput = measureLayoutThroughput(scene, projMatrix, viewMatrix, width, height, tileSize, layout, repeatCount);
+
+        std::ostringstream config;
+        config << "layout=" << (layout == TilePixelLayout::Morton ? "morton" : "row-major") << " resolution=" << width << "x" << height << " tileSize=" << tileSize;
+
+        printResult("pixel-layout", config.str(), "primary_throughput", throughput.primaryRaysPerSecond, "Mrays/s");
+        printResult("pixel-layout", config.str(), "ao_throughput", throughput.aoRaysPerSecond, "Mrays/s");
+    }
+
+    return 0;
+}
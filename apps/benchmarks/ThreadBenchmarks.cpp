@@ -0,0 +1,172 @@
+#include <atomic>
+#include <sstream>
+#include <random>
+
+#include <c2ba/threads.hpp>
+#include <c2ba/maths.hpp>
+
+#include "Benchmarks.hpp"
+
+using namespace c2ba;
+
+namespace
+{
+
+// The previous model of asyncParallelRun: a new detached std::thread for each task, kept for comparison
+template<typename TaskFunctor>
+std::future<void> detachParallelRun(uint32_t threadCount, TaskFunctor task)
+{
+    struct SharedData
+    {
+        std::promise<void> p;
+        ~SharedData()
+        {
+            p.set_value();
+        }
+    };
+    std::shared_ptr<SharedData> sharedData = std::make_shared<SharedData>();
+    for (auto i = 0u; i < threadCount; ++i) {
+        std::thread t([i, task, sharedData]() { task(i); });
+        t.detach();
+    }
+    return sharedData->p.get_future();
+}
+
+template<typename RunFunctor>
+void benchmarkModel(const std::string & model, uint32_t threadCount, size_t repeatCount, RunFunctor run)
+{
+    std::ostringstream config;
+    config << "model=" << model << " threads=" << threadCount;
+
+    // Latency: time between the launch call and the start of the first task
+    std::vector<double> latencies;
+    latencies.reserve(repeatCount);
+    for (size_t i = 0; i < repeatCount; ++i)
+    {
+        std::atomic<bool> started{ false };
+        Clock::time_point firstStart;
+        const auto launch = Clock::now();
+        run(threadCount, [&](size_t)
+        {
+            auto now = Clock::now();
+            if (!started.exchange(true)) {
+                firstStart = now;
+            }
+        }).wait();
+        latencies.emplace_back(microseconds(firstStart - launch));
+    }
+
+    printResult("task-launch", config.str(), "latency_median", median(latencies), "us");
+    printResult("task-launch", config.str(), "latency_mean", mean(latencies), "us");
+
+    // Throughput: back to back batches of threadCount tiny tasks
+    std::atomic<size_t> counter{ 0 };
+    const auto totalTime = measureMicroseconds([&]()
+    {
+        for (size_t i = 0; i < repeatCount; ++i) {
+            run(threadCount, [&](size_t) { ++counter; }).wait();
+        }
+    });
+
+    printResult("task-launch", config.str(), "batch_time", totalTime / repeatCount, "us");
+    printResult("task-launch", config.str(), "throughput", counter * 1e6 / totalTime, "tasks/s");
+}
+
+// Per thread state of the parallel loop benchmark: constructed once per thread, like the scratch buffers of a real loop
+struct LoopThreadData
+{
+    std::mt19937 generator;
+    std::uniform_real_distribution<float> distribution{ 0.f, 1.f };
+    float3 sum{ 0.f };
+
+    LoopThreadData(uint32_t seed) : generator(seed) {}
+};
+
+const char * scheduleName(ParallelSchedule schedule)
+{
+    switch (schedule)
+    {
+    case ParallelSchedule::Static:
+        return "static";
+    case ParallelSchedule::Dynamic:
+        return "dynamic";
+    case ParallelSchedule::Guided:
+        return "guided";
+    }
+    return "";
+}
+
+}
+
+// Arguments: [ threadCount = getDefaultThreadCount() ] [ repeatCount = 1000 ]
+int benchmarkTaskLaunch(int argc, char** argv)
+{
+    const auto threadCount = uint32_t(getArg(argc, argv, 0, getDefaultThreadCount()));
+    const auto repeatCount = getArg(argc, argv, 1, 1000);
+
+    setThreadCount(threadCount);
+
+    // Warm up the pool so its creation is not measured
+    syncParallelRun(threadCount, [](size_t) {});
+
+    benchmarkModel("pool", threadCount, repeatCount, [](uint32_t count, auto task) { return asyncParallelRun(count, task); });
+    benchmarkModel("detach", threadCount, repeatCount, [](uint32_t count, auto task) { return detachParallelRun(count, task); });
+
+    return 0;
+}
+
+// Arguments: [ maxThreadCount = getHardwareConcurrency() ] [ runCount = 4096 ] [ samplesPerRun = 1024 ]
+//
+// Each run draws samplesPerRun cosine distributed directions. With the "uniform" workload all runs have the same cost,
+// with the "triangle" workload the cost of a run grows linearly with its index, which penalizes static scheduling.
+int benchmarkParallelLoop(int argc, char** argv)
+{
+    const auto maxThreadCount = uint32_t(getArg(argc, argv, 0, getHardwareConcurrency()));
+    const auto runCount = uint32_t(getArg(argc, argv, 1, 4096));
+    const auto samplesPerRun = getArg(argc, argv, 2, 1024);
+
+    const ParallelSchedule schedules[] = { ParallelSchedule::Static, ParallelSchedule::Dynamic, ParallelSchedule::Guided };
+    const uint32_t grainSizes[] = { 1, 16, 256 };
+    const bool triangleWorkloads[] = { false, true };
+
+    for (const auto triangle : triangleWorkloads)
+    {
+        for (const auto schedule : schedules)
+        {
+            for (const auto grainSize : grainSizes)
+            {
+                double singleThreadTime = 0.;
+                for (auto threadCount = 1u; threadCount <= maxThreadCount; ++threadCount)
+                {
+                    setThreadCount(threadCount);
+
+                    const auto time = measureMicroseconds([&]()
+                    {
+                        asyncParallelLoop<LoopThreadData>(runCount, ParallelLoopOptions{ schedule, grainSize, threadCount },
+                            [&](uint32_t runId, uint32_t threadId, LoopThreadData & data)
+                        {
+                            const auto sampleCount = triangle ? 1 + 2 * samplesPerRun * runId / runCount : samplesPerRun;
+                            for (size_t i = 0; i < sampleCount; ++i) {
+                                data.sum += sampleHemisphereCosine(data.distribution(data.generator), data.distribution(data.generator));
+                            }
+                        }, 1234u).wait();
+                    });
+
+                    if (threadCount == 1) {
+                        singleThreadTime = time;
+                    }
+
+                    std::ostringstream config;
+                    config << "workload=" << (triangle ? "triangle" : "uniform") << " schedule=" << scheduleName(schedule)
+                        << " grain=" << grainSize << " threads=" << threadCount;
+
+                    printResult("parallel-loop", config.str(), "time", time / 1000., "ms");
+                    printResult("parallel-loop", config.str(), "speedup", singleThreadTime / time, "x");
+                    printResult("parallel-loop", config.str(), "efficiency", 100. * singleThreadTime / (time * threadCount), "%");
+                }
+            }
+        }
+    }
+
+    return 0;
+}
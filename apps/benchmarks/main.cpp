@@ -0,0 +1,30 @@
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "Benchmarks.hpp"
+
+int main(int argc, char** argv)
+{
+    const std::map<std::string, BenchmarkFunction> benchmarks = {
+        { "task-launch", benchmarkTaskLaunch },
+        { "parallel-loop", benchmarkParallelLoop },
+        { "first-tile", benchmarkFirstTile },
+        { "framebuffer-storage", benchmarkFramebufferStorage },
+        { "pixel-layout", benchmarkPixelLayout },
+        { "ray-throughput", benchmarkRayThroughput },
+        { "kernels", benchmarkKernels }
+    };
+
+    if (argc < 2 || !benchmarks.count(argv[1]))
+    {
+        std::cerr << "Usage : " << argv[0] << " < benchmark > [ benchmark arguments ]" << std::endl;
+        std::cerr << "Available benchmarks:" << std::endl;
+        for (const auto & benchmark : benchmarks) {
+            std::cerr << "  " << benchmark.first << std::endl;
+        }
+        return -1;
+    }
+
+    return benchmarks.at(argv[1])(argc - 2, argv + 2);
+}
@@ -7,6 +7,7 @@
 #include <deque>
 #include <tuple>
 #include <algorithm>
+#include <cmath>
 #include <numeric>
 #include <random>
 
@@ -23,6 +24,7 @@
 #include <c2ba/rendering/TileRenderer.hpp>
 #include <c2ba/maths.hpp>
 #include <c2ba/utils.hpp>
+#include <c2ba/Trace.hpp>
 
 using namespace c2ba;
 
@@ -125,11 +127,49 @@ int main(int argc, char** argv)
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
-    GLuint m_FramebufferTexture;
-    glGenTextures(1, &m_FramebufferTexture);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_FramebufferTexture);
-    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, m_nWindowWidth, m_nWindowHeight);
+    // Texture formats matching the pixel formats of the renderer: internal format, upload format and upload type
+    const std::tuple<PixelFormat, GLenum, GLenum, GLenum> m_PixelFormats[] = {
+        std::make_tuple(PixelFormat::RGBA32F, GL_RGBA32F, GL_RGBA, GL_FLOAT),
+        std::make_tuple(PixelFormat::RGBA8, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE),
+        std::make_tuple(PixelFormat::RGB10A2, GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV)
+    };
+    const char * m_PixelFormatNames[] = { "RGBA32F", "RGBA8 sRGB", "RGB10A2 sRGB" };
+    int m_PixelFormatIdx = 0;
+
+    // Texture storage is immutable: a new texture is created for each pixel format
+    GLuint m_FramebufferTexture = 0;
+    const auto createFramebufferTexture = [&]()
+    {
+        glDeleteTextures(1, &m_FramebufferTexture);
+        glGenTextures(1, &m_FramebufferTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_FramebufferTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, std::get<1>(m_PixelFormats[m_PixelFormatIdx]), m_nWindowWidth, m_nWindowHeight);
+    };
+    createFramebufferTexture();
+
+    // Heatmap of AOV::RenderCost, displayed instead of the image when enabled
+    bool m_bShowRenderCost = false;
+    float m_RenderCostScale = 0.f; // Cost displayed in red, the 99th percentile of the costs of the pixels
+    std::vector<float> m_SampledRenderCosts;
+    GLuint m_RenderCostTexture = 0; // The costs themselves, colour-mapped by the draw quad shader
+    glGenTextures(1, &m_RenderCostTexture);
+    glBindTexture(GL_TEXTURE_2D, m_RenderCostTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, m_nWindowWidth, m_nWindowHeight);
+
+    // The percentile is estimated from a few thousand pixels, the stride being odd so that they do not fall on a few columns
+    const auto updateRenderCostScale = [&](const float * costs)
+    {
+        const auto imagePixelCount = m_nWindowWidth * m_nWindowHeight;
+        const auto stride = (imagePixelCount / 4096) | 1;
+        m_SampledRenderCosts.clear();
+        for (size_t pixelIdx = 0; pixelIdx < imagePixelCount; pixelIdx += stride) {
+            m_SampledRenderCosts.emplace_back(costs[pixelIdx]);
+        }
+        const auto percentile = m_SampledRenderCosts.begin() + m_SampledRenderCosts.size() * 99 / 100;
+        std::nth_element(m_SampledRenderCosts.begin(), percentile, m_SampledRenderCosts.end());
+        m_RenderCostScale = *percentile;
+    };
 
     const auto m_program = compileProgram({ m_ShadersRootPath / m_AppName / "forward.vs.glsl", m_ShadersRootPath / m_AppName / "forward.fs.glsl" });
     
@@ -141,6 +181,8 @@ int main(int argc, char** argv)
 
     const auto m_uImage = glGetUniformLocation(m_drawQuadProgram.glId(), "uImage");
     glProgramUniform1i(m_drawQuadProgram.glId(), m_uImage, 0);
+    const auto m_uRenderCostHeatmap = glGetUniformLocation(m_drawQuadProgram.glId(), "uRenderCostHeatmap");
+    const auto m_uRenderCostRcpScale = glGetUniformLocation(m_drawQuadProgram.glId(), "uRenderCostRcpScale");
 
     ViewController m_viewController{ m_pWindow };
     m_viewController.setViewMatrix(glm::lookAt(glm::vec3(0, 0, 5), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0)));
@@ -191,8 +233,19 @@ int main(int argc, char** argv)
             glDisable(GL_DEPTH_TEST);
             m_drawQuadProgram.use();
 
-            glBindTexture(GL_TEXTURE_2D, m_FramebufferTexture);
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_nWindowWidth, m_nWindowHeight, GL_RGBA, GL_FLOAT, renderer.getPixels());
+            const auto renderCosts = m_bShowRenderCost ? renderer.getAOVPixels(AOV::RenderCost) : nullptr;
+            glUniform1i(m_uRenderCostHeatmap, renderCosts != nullptr);
+            if (renderCosts) {
+                updateRenderCostScale(renderCosts);
+                glUniform1f(m_uRenderCostRcpScale, m_RenderCostScale > 0.f ? 1.f / m_RenderCostScale : 0.f);
+                glBindTexture(GL_TEXTURE_2D, m_RenderCostTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_nWindowWidth, m_nWindowHeight, GL_RED, GL_FLOAT, renderCosts);
+            }
+            else {
+                glBindTexture(GL_TEXTURE_2D, m_FramebufferTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_nWindowWidth, m_nWindowHeight,
+                    std::get<2>(m_PixelFormats[m_PixelFormatIdx]), std::get<3>(m_PixelFormats[m_PixelFormatIdx]), renderer.getPixels());
+            }
 
             glBindVertexArray(m_TriangleVAO);
             glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -224,6 +277,105 @@ int main(int argc, char** argv)
                 renderer.stop();
             }
 
+            ImGui::Text("Tile size: %d%s", int(renderer.tileSize()), renderer.isTuningTileSize() ? " (tuning)" : "");
+
+            auto mortonPixels = renderer.tilePixelLayout() == TilePixelLayout::Morton;
+            if (ImGui::Checkbox("Morton pixel order", &mortonPixels))
+            {
+                renderer.setTilePixelLayout(mortonPixels ? TilePixelLayout::Morton : TilePixelLayout::RowMajor);
+            }
+
+            // Time spent per sample of each pixel, to find the geometry that is expensive to render
+            if (ImGui::Checkbox("Render cost heatmap", &m_bShowRenderCost))
+            {
+                renderer.setAOVs(m_bShowRenderCost ? renderer.aovs() | aovBit(AOV::RenderCost) : renderer.aovs() & ~aovBit(AOV::RenderCost));
+            }
+            if (m_bShowRenderCost)
+            {
+                ImGui::Text("Red: %.0f ns per sample and above", m_RenderCostScale);
+            }
+
+            // Display formats are divided by the sample count on the CPU: the shader divides them by an alpha of 1
+            if (ImGui::Combo("Pixel format", &m_PixelFormatIdx, m_PixelFormatNames, 3))
+            {
+                renderer.setPixelFormat(std::get<0>(m_PixelFormats[m_PixelFormatIdx]));
+                createFramebufferTexture();
+            }
+
+            // Other processes map "/c2ba-hello-scene" to read the images, see SharedImageHeader
+            auto shareImage = renderer.isSharingImage();
+            if (ImGui::Checkbox("Share image", &shareImage))
+            {
+                renderer.setSharedImage(shareImage ? "/c2ba-hello-scene" : "");
+            }
+
+            auto exposure = renderer.exposure();
+            if (ImGui::SliderFloat("Exposure", &exposure, -4.f, 4.f))
+            {
+                renderer.setExposure(exposure);
+            }
+
+            auto targetError = renderer.targetError();
+            if (ImGui::SliderFloat("Target error", &targetError, 0.f, 0.2f))
+            {
+                renderer.setTargetError(targetError);
+            }
+            ImGui::Text("Converged tiles: %d / %d%s", int(renderer.convergedTileCount()), int(renderer.tileCount()), renderer.isConverged() ? " (converged)" : "");
+
+            auto frameBudget = renderer.frameBudget();
+            if (ImGui::SliderFloat("Frame budget (ms)", &frameBudget, 0.f, 100.f))
+            {
+                renderer.setFrameBudget(frameBudget);
+            }
+            if (renderer.frameBudget() > 0.f)
+            {
+                const auto frameStats = renderer.lastFrameStats();
+                ImGui::Text("Frame: %.2f ms, %.0f%% of budget, %llu tile samples, published %.2f ms after the deadline", frameStats.frameMilliseconds, 100.f * frameStats.budgetUsage,
+                    (unsigned long long)frameStats.sampleCount, frameStats.publishLatencyMilliseconds);
+            }
+
+            const auto stats = renderer.stats();
+            ImGui::Text("Rendered tiles: %llu", (unsigned long long)stats.renderedTileCount);
+            ImGui::Text("Canceled tiles: %llu", (unsigned long long)stats.canceledTileCount);
+            ImGui::Text("Contended tiles: %llu", (unsigned long long)stats.contendedTileCount);
+            ImGui::Text("Split tiles: %llu", (unsigned long long)stats.splitTileCount);
+
+            if (ImGui::CollapsingHeader("Thread counters"))
+            {
+                // Shading is the render time spent outside of the scene queries
+                const auto showCounters = [](const std::string & label, const RenderCounterValues & values)
+                {
+                    const auto get = [&values](RenderCounter counter) { return values[size_t(counter)]; };
+                    const auto ms = [&get](RenderCounter counter) { return get(counter) * 1e-6; };
+                    const auto traceTime = ms(RenderCounter::IntersectTime) + ms(RenderCounter::OccludedTime);
+                    ImGui::Text("%s: %llu passes, %.1f Mrays, trace %.0f ms, shading %.0f ms", label.c_str(), (unsigned long long)get(RenderCounter::TilePasses),
+                        (get(RenderCounter::PrimaryRays) + get(RenderCounter::OcclusionRays)) * 1e-6, traceTime, ms(RenderCounter::RenderTime) - traceTime);
+                    ImGui::Text("    resolve %.1f ms (claim wait %.1f ms), paused %.0f ms, frame wait %.0f ms", ms(RenderCounter::ResolveTime),
+                        ms(RenderCounter::ClaimWaitTime), ms(RenderCounter::PausedTime), ms(RenderCounter::FrameWaitTime));
+                };
+
+                const auto & counters = renderer.counters();
+                showCounters("All threads", counters.total());
+                for (size_t threadId = 0; threadId < counters.threadCount(); ++threadId) {
+                    showCounters("Thread " + std::to_string(threadId), counters.threadValues(threadId));
+                }
+            }
+
+            // Timeline of the render threads, to open in chrome://tracing or https://ui.perfetto.dev
+            auto recordTrace = isTracing();
+            if (ImGui::Checkbox("Record trace", &recordTrace))
+            {
+                recordTrace ? startTracing() : stopTracing();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Save trace"))
+            {
+                stopTracing();
+                if (!writeChromeTrace("c2ba-trace.json")) {
+                    std::cerr << "Unable to write c2ba-trace.json" << std::endl;
+                }
+            }
+
             ImGui::End();
         }
 
@@ -1,12 +1,23 @@
 #version 330
 
 uniform sampler2D uImage;
+uniform bool uRenderCostHeatmap; // uImage holds the render cost of the pixels in its red channel
+uniform float uRenderCostRcpScale; // Inverse of the cost displayed in red
 
 out vec3 fColor;
 
 void main()
 {
     vec4 value = texelFetch(uImage, ivec2(gl_FragCoord.xy), 0);
+    if (uRenderCostHeatmap)
+    {
+        // Costs from blue (cheap) to green and red (expensive), pixels without cost yet are discarded
+        if (value.r <= 0.f)
+            discard;
+        float t = min(value.r * uRenderCostRcpScale, 1.f);
+        fColor = vec3(max(2.f * t - 1.f, 0.f), 1.f - abs(2.f * t - 1.f), max(1.f - 2.f * t, 0.f));
+        return;
+    }
     if (value.a == 0.f)
         discard;
     fColor = value.rgb / value.a;
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace c2ba
+{
+
+// A file mapped in memory for reading and writing. Writes to the memory reach the file through the system page cache,
+// so that they survive the process being killed. flush() waits for them to reach the disk.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator =(const MappedFile &) = delete;
+
+    // Map a file, created if it does not exist and resized to byteSize. Bytes added to the file are zeros.
+    //
+    // \arg discardContent Truncate the file before resizing it, so that all its bytes are zeros
+    //
+    // \return false if the file cannot be opened or mapped
+    bool open(const std::string & path, size_t byteSize, bool discardContent = false);
+
+    void close();
+
+    // Write the modified pages of the mapping to the disk and wait for the writes to complete
+    //
+    // \return false if the writes failed
+    bool flush();
+
+    bool isOpen() const
+    {
+        return m_pData != nullptr;
+    }
+
+    void * data() const
+    {
+        return m_pData;
+    }
+
+    size_t byteSize() const
+    {
+        return m_nByteSize;
+    }
+
+private:
+    void * m_pData = nullptr;
+    size_t m_nByteSize = 0;
+#ifdef _WIN32
+    void * m_FileHandle = nullptr;
+    void * m_MappingHandle = nullptr;
+#else
+    int m_FileDescriptor = -1;
+#endif
+};
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace c2ba
+{
+
+// A named segment of memory shared between the processes of the machine: POSIX shared memory, or a named file mapping on Windows.
+// The creator maps it for reading and writing, other processes map it read only.
+class SharedMemory
+{
+public:
+    SharedMemory() = default;
+
+    ~SharedMemory()
+    {
+        close();
+    }
+
+    SharedMemory(const SharedMemory &) = delete;
+    SharedMemory & operator =(const SharedMemory &) = delete;
+
+    // Create a segment of byteSize zero bytes, replacing any segment with the same name. The segment is removed when closed by its creator,
+    // processes that still map it keep their mapping.
+    //
+    // \arg name A name starting with '/' for portability, e.g. "/c2ba-render"
+    //
+    // \return false if the segment cannot be created or mapped
+    bool create(const std::string & name, size_t byteSize);
+
+    // Map an existing segment read only
+    //
+    // \return false if the segment does not exist or cannot be mapped
+    bool openReadOnly(const std::string & name);
+
+    void close();
+
+    bool isOpen() const
+    {
+        return m_pData != nullptr;
+    }
+
+    void * data() const
+    {
+        return m_pData;
+    }
+
+    size_t byteSize() const
+    {
+        return m_nByteSize;
+    }
+
+    const std::string & name() const
+    {
+        return m_Name;
+    }
+
+private:
+    void * m_pData = nullptr;
+    size_t m_nByteSize = 0;
+    std::string m_Name;
+    bool m_bCreator = false;
+#ifdef _WIN32
+    void * m_MappingHandle = nullptr;
+#else
+    int m_FileDescriptor = -1;
+#endif
+};
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <string>
+#include <ostream>
+
+namespace c2ba
+{
+
+// Timeline of scoped events, exported in the Chrome trace event format to be viewed in chrome://tracing or https://ui.perfetto.dev
+//
+// Each thread records its events in its own ring buffer, without locks: the oldest events of a thread are overwritten once its buffer is full.
+// Recording is disabled by default, in which case a TraceScope costs a function call.
+
+// Start recording events. Events recorded before are not exported anymore.
+//
+// \arg eventCapacity Size of the ring buffer of the threads recording their first event from now on, in events. Buffers of the other
+//  threads keep their size.
+void startTracing(size_t eventCapacity = 1 << 16);
+
+void stopTracing();
+
+bool isTracing();
+
+// Write the events recorded since the last startTracing() as a Chrome trace JSON object. Events recorded while writing may be exported
+// partially updated: write the trace once traced threads are idle, e.g. after stopTracing().
+void writeChromeTrace(std::ostream & out);
+
+// \return false if the file cannot be written
+bool writeChromeTrace(const std::string & path);
+
+// Nanoseconds of the steady clock, the time base of the events
+inline uint64_t traceTimestamp()
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Record an event of the calling thread
+//
+// \arg name, argName Static strings, e.g. literals: only their address is recorded. argName is nullptr for events without argument.
+void recordTraceEvent(const char * name, const char * argName, int64_t argValue, uint64_t beginTimestamp, uint64_t endTimestamp);
+
+// Event spanning the lifetime of the object, recorded if tracing is enabled when the object is created
+class TraceScope
+{
+public:
+    // \arg name, argName Static strings, see recordTraceEvent()
+    explicit TraceScope(const char * name, const char * argName = nullptr, int64_t argValue = 0) :
+        m_Name(isTracing() ? name : nullptr), m_ArgName(argName), m_ArgValue(argValue), m_BeginTimestamp(m_Name ? traceTimestamp() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_Name) {
+            recordTraceEvent(m_Name, m_ArgName, m_ArgValue, m_BeginTimestamp, traceTimestamp());
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope & operator =(const TraceScope &) = delete;
+
+private:
+    const char * m_Name;
+    const char * m_ArgName;
+    int64_t m_ArgValue;
+    uint64_t m_BeginTimestamp;
+};
+
+}
@@ -72,6 +72,12 @@ inline float3 faceForward(const float3 & v, const float3 & ref)
     return v;
 }
 
+// Relative luminance of a linear RGB color (Rec. 709 primaries)
+inline float luminance(const float3 & rgb)
+{
+    return dot(rgb, float3(0.2126f, 0.7152f, 0.0722f));
+}
+
 template<typename OutType>
 inline OutType divideW(const float4 & v)
 {
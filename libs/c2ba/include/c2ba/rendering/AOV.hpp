@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+namespace c2ba
+{
+
+// Arbitrary output variables: per pixel channels written by integrators next to the accumulated color, in the same pass.
+// Integrators only write the AOVs enabled in the framebuffer, the ones they do not support stay at zero.
+enum class AOV : uint32_t
+{
+    Depth, // Distance from the camera to the primary hit point, 0 for missed primary rays
+    Normal, // World space shading normal at the primary hit point, 0 for missed primary rays
+    GeometryID, // Embree geometry ID of the primary hit point, -1 for missed primary rays. Not averaged: the ID of the last sample is kept.
+    AmbientOcclusion, // Fraction of unoccluded ambient occlusion rays at the primary hit point
+    RenderCost // Nanoseconds spent in Integrator::render() per sample of the pixel, see Integrator::addPixelCost(). Not deterministic.
+};
+
+static const size_t AOVCount = 5;
+
+// A set of AOVs, as a bit mask of aovBit()
+using AOVSet = uint32_t;
+
+// Output images of the AOVs, indexed by AOV. Each image stores aovComponentCount() floats per pixel, nullptr for AOVs to skip.
+using AOVImages = std::array<float *, AOVCount>;
+
+inline AOVSet aovBit(AOV aov)
+{
+    return 1u << uint32_t(aov);
+}
+
+inline bool hasAOV(AOVSet aovs, AOV aov)
+{
+    return (aovs & aovBit(aov)) != 0;
+}
+
+inline const char * aovName(AOV aov)
+{
+    static const char * names[AOVCount] = { "depth", "normal", "geometry_id", "ambient_occlusion", "render_cost" };
+    return names[size_t(aov)];
+}
+
+inline size_t aovComponentCount(AOV aov)
+{
+    return aov == AOV::Normal ? 3 : 1;
+}
+
+// \return The number of components of all the AOVs of a set
+inline size_t aovComponentCount(AOVSet aovs)
+{
+    size_t count = 0;
+    for (size_t aovIdx = 0; aovIdx < AOVCount; ++aovIdx) {
+        if (hasAOV(aovs, AOV(aovIdx))) {
+            count += aovComponentCount(AOV(aovIdx));
+        }
+    }
+    return count;
+}
+
+// Averaged AOVs accumulate the values of their samples like the color, the others keep the value of the last sample
+inline bool isAveragedAOV(AOV aov)
+{
+    return aov != AOV::GeometryID;
+}
+
+}
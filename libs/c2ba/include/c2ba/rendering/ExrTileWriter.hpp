@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "c2ba/maths.hpp"
+#include "AOV.hpp"
+
+namespace c2ba
+{
+
+enum class ExrCompression
+{
+    None,
+    Zip, // Lossless, blocks of 16 scanlines: a good default for tiles
+    Piz // Lossless wavelet, better ratios on noisy images
+};
+
+// Writer of a tiled OpenEXR file, fed with rows of tiles: only the rows being written are held in memory, so that the resolution of the image
+// is bounded by the disk rather than the RAM. The color is stored in half floats in the R, G, B channels, AOVs in floats in channels named
+// by aovName(), suffixed with .X, .Y, .Z for multi-component AOVs. Tiles of a row are compressed in parallel by the global OpenEXR thread pool,
+// which has its own threads, distinct from the ones of c2ba::ThreadPool.
+// OpenEXR errors are thrown as exceptions derived from std::exception.
+class ExrTileWriter
+{
+public:
+    // Create the file with one level of tileSize x tileSize tiles.
+    //
+    // \arg threadCount Threads of the global OpenEXR thread pool while the writer exists, its previous size being restored by the destructor.
+    //  0 keeps its current size, which is 0 by default: tiles are then compressed one after the other by the writing thread.
+    ExrTileWriter(const std::string & path, size_t imageWidth, size_t imageHeight, size_t tileSize, AOVSet aovs = 0,
+        ExrCompression compression = ExrCompression::Zip, uint32_t threadCount = 0);
+
+    // The file is complete once all rows have been written and the writer is destroyed. Restores the size of the OpenEXR thread pool.
+    ~ExrTileWriter();
+
+    ExrTileWriter(const ExrTileWriter &) = delete;
+    ExrTileWriter & operator =(const ExrTileWriter &) = delete;
+
+    // Write a row of tiles. Rows can be written in any order.
+    //
+    // \arg pixels Mean color of the pixels of the rows of the image covered by the tiles, imageWidth() pixels per row from top to bottom
+    //  as in the file, see flipRows(). Alpha is ignored.
+    // \arg aovImages Images of the AOVs of the file for the same rows, aovComponentCount() floats per pixel
+    void writeTileRow(size_t tileY, const float4 * pixels, const AOVImages & aovImages);
+
+    size_t imageWidth() const
+    {
+        return m_nImageWidth;
+    }
+
+    size_t imageHeight() const
+    {
+        return m_nImageHeight;
+    }
+
+    size_t tileSize() const
+    {
+        return m_nTileSize;
+    }
+
+    size_t tileCountY() const
+    {
+        return (m_nImageHeight + m_nTileSize - 1) / m_nTileSize;
+    }
+
+private:
+    struct File; // Keeps OpenEXR headers out of this one
+
+    std::unique_ptr<File> m_File;
+    size_t m_nImageWidth;
+    size_t m_nImageHeight;
+    size_t m_nTileSize;
+    AOVSet m_AOVs;
+    int m_nPreviousThreadCount = -1; // Of the OpenEXR thread pool, -1 if unchanged
+};
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "../maths.hpp"
+
+namespace c2ba
+{
+
+// Format of the images resolved from a tiled framebuffer
+enum class PixelFormat
+{
+    RGBA32F, // Accumulated samples: sum of the samples in rgb, sample count in alpha
+    RGBA8, // Display ready: mean of the samples scaled by the exposure and sRGB encoded, alpha is 0 for pixels without samples and 1 otherwise
+    RGB10A2 // Same as RGBA8 with 10 bits per color channel, packed from the lowest bits as GL_UNSIGNED_INT_2_10_10_10_REV
+};
+
+inline size_t pixelByteSize(PixelFormat format)
+{
+    return format == PixelFormat::RGBA32F ? sizeof(float4) : sizeof(uint32_t);
+}
+
+// Convert accumulated pixels to a pixel format. Uses SSE2 when available.
+//
+// \arg exposureScale Factor applied to the mean of the samples before sRGB encoding, ignored for RGBA32F
+void convertPixels(const float4 * pixels, size_t count, PixelFormat format, float exposureScale, void * outPixels);
+
+// Same as convertPixels() without SIMD instructions, as a reference for the vectorized path
+void convertPixelsScalar(const float4 * pixels, size_t count, PixelFormat format, float exposureScale, void * outPixels);
+
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+
+#include "../MappedFile.hpp"
+
+namespace c2ba
+{
+
+// A checkpoint file of a render: a header and the persistent memory of a tiled framebuffer. The file is mapped in memory and the framebuffer
+// is stored in it, so that tiles are saved as they are rendered and survive the process being killed. Checkpointed renders sample
+// deterministically with the seed of the header: the samples of a tile only depend on their pixel and index, so that a resumed render
+// continues exactly where the tiles stopped, whatever the number of threads.
+class RenderCheckpoint
+{
+public:
+    // Framebuffer of a checkpoint, a checkpoint is only resumed by a framebuffer of the same configuration
+    struct Config
+    {
+        uint32_t texelByteSize; // Identifies the tile storage
+        uint32_t tileSize;
+        uint32_t imageWidth;
+        uint32_t imageHeight;
+        uint32_t pixelLayout;
+        uint32_t aovs;
+
+        bool operator ==(const Config & other) const
+        {
+            return texelByteSize == other.texelByteSize && tileSize == other.tileSize && imageWidth == other.imageWidth &&
+                imageHeight == other.imageHeight && pixelLayout == other.pixelLayout && aovs == other.aovs;
+        }
+    };
+
+    // Read the configuration of an existing checkpoint file
+    //
+    // \return false if the file does not exist or is not a checkpoint
+    static bool readConfig(const std::string & path, Config & config)
+    {
+        Header header;
+        std::ifstream in(path, std::ios::binary);
+        if (!in.read((char *)&header, sizeof(header)) || !header.isValid()) {
+            return false;
+        }
+        config = header.config;
+        return true;
+    }
+
+    // Map a checkpoint file for a framebuffer. The content of the file is discarded unless it is a checkpoint of the same configuration.
+    // An existing file that is not a checkpoint is left untouched.
+    //
+    // \arg framebufferByteSize Size of the persistent memory of the framebuffer
+    // \arg seed Seed of a new checkpoint, a resumed checkpoint keeps its own, see seed()
+    //
+    // \return false if the file is not a checkpoint or cannot be mapped
+    bool open(const std::string & path, const Config & config, size_t framebufferByteSize, uint32_t seed)
+    {
+        close();
+
+        // The header is checked before mapping the file, which resizes it
+        auto discardContent = true;
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (in && in.tellg() > 0) {
+            Header fileHeader;
+            if (!in.seekg(0).read((char *)&fileHeader, sizeof(fileHeader)) || !fileHeader.hasMagic()) {
+                return false;
+            }
+            discardContent = !fileHeader.isValid() || !(fileHeader.config == config) || fileHeader.framebufferByteSize != framebufferByteSize;
+        }
+        in.close();
+
+        // Zeros are an empty framebuffer
+        const auto byteSize = s_HeaderByteSize + framebufferByteSize;
+        if (!m_File.open(path, byteSize, discardContent)) {
+            return false;
+        }
+
+        m_bResumed = !discardContent;
+        if (discardContent) {
+            auto & newHeader = header();
+            std::memcpy(newHeader.magic, s_Magic, sizeof(newHeader.magic));
+            newHeader.version = s_Version;
+            newHeader.config = config;
+            newHeader.framebufferByteSize = framebufferByteSize;
+            newHeader.seed = seed;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        m_File.close();
+        m_bResumed = false;
+    }
+
+    bool isOpen() const
+    {
+        return m_File.isOpen();
+    }
+
+    // \return true if the file held a checkpoint of the same configuration when it has been opened
+    bool isResumed() const
+    {
+        return m_bResumed;
+    }
+
+    void * framebufferMemory() const
+    {
+        return (char *)m_File.data() + s_HeaderByteSize;
+    }
+
+    // Epoch of the renderer that has written the tiles of the framebuffer, tiles stamped with another epoch are stale
+    uint32_t epoch() const
+    {
+        return header().epoch;
+    }
+
+    void setEpoch(uint32_t epoch)
+    {
+        header().epoch = epoch;
+    }
+
+    // Seed of the deterministic sampling of the checkpointed render, see Integrator::setDeterministic()
+    uint32_t seed() const
+    {
+        return header().seed;
+    }
+
+    // Wait for the checkpoint to reach the disk
+    bool flush()
+    {
+        return m_File.flush();
+    }
+
+private:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        Config config;
+        uint32_t epoch;
+        uint64_t framebufferByteSize;
+        uint32_t seed;
+
+        // Checkpoint of any version
+        bool hasMagic() const
+        {
+            return !std::memcmp(magic, s_Magic, sizeof(magic));
+        }
+
+        bool isValid() const
+        {
+            return hasMagic() && version == s_Version;
+        }
+    };
+
+    Header & header() const
+    {
+        return *(Header *)m_File.data();
+    }
+
+    static constexpr const char * s_Magic = "C2BACKPT";
+    static const uint32_t s_Version = 2; // Version 1 stored the states of the random generators of the render threads instead of a seed
+    static const size_t s_HeaderByteSize = 4096; // Keeps the framebuffer page aligned
+
+    MappedFile m_File;
+    bool m_bResumed = false;
+};
+
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+namespace c2ba
+{
+
+// What render threads spend their time on. Times are in nanoseconds.
+enum class RenderCounter : uint32_t
+{
+    TilePasses, // Tile samples completed, a split tile counting once for the thread owning it
+    CanceledPasses, // Tile samples abandoned because of a camera change
+    ContendedTiles, // Tiles skipped because another thread was rendering them
+    SplitBands, // Bands of split tiles rendered, for the owner of the tile or to help it
+    ResolvedTiles, // Tiles copied to the images
+    PrimaryRays, // Rays traced with Scene::intersect(), inactive lanes of packets included
+    OcclusionRays, // Rays traced with Scene::occluded(), inactive lanes of packets included
+    RenderTime, // In Integrator::render()
+    IntersectTime, // In Scene::intersect(), part of RenderTime. Estimated from a sample of the single ray queries, see Integrator::countIntersect().
+    OccludedTime, // In Scene::occluded(), part of RenderTime. Same as IntersectTime.
+    ResolveTime, // Copying tiles to the images, waits for the tiles claimed by other threads included
+    ClaimWaitTime, // Waiting for tiles claimed by other threads, to copy them, or backing off after failing to claim tiles to render
+    PausedTime, // Parked in pause()
+    FrameWaitTime // Waiting for the next frame with a frame budget
+};
+
+static const size_t RenderCounterCount = 14;
+
+using RenderCounterValues = std::array<uint64_t, RenderCounterCount>;
+
+inline const char * renderCounterName(RenderCounter counter)
+{
+    static const char * names[RenderCounterCount] = { "tile_passes", "canceled_passes", "contended_tiles", "split_bands", "resolved_tiles",
+        "primary_rays", "occlusion_rays", "render_ns", "intersect_ns", "occluded_ns", "resolve_ns", "claim_wait_ns", "paused_ns", "frame_wait_ns" };
+    return names[size_t(counter)];
+}
+
+// Counters of the render threads. Each thread only writes its own counters, with relaxed loads and stores rather than read-modify-write
+// instructions, and the counters of two threads never share a cache line: counting costs a few instructions and no cache line transfer.
+// Other threads can read them at any time, the values are then the ones of a recent past.
+class RenderCounters
+{
+public:
+    // Zero the counters. Must not be called while threads count.
+    void reset(size_t threadCount)
+    {
+        m_Threads = std::vector<ThreadCounters>(threadCount);
+        for (auto & thread : m_Threads) {
+            for (auto & value : thread.values) {
+                value.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Must only be called by the thread threadId
+    void add(size_t threadId, RenderCounter counter, uint64_t value)
+    {
+        auto & counterValue = m_Threads[threadId].values[size_t(counter)];
+        counterValue.store(counterValue.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    size_t threadCount() const
+    {
+        return m_Threads.size();
+    }
+
+    RenderCounterValues threadValues(size_t threadId) const
+    {
+        RenderCounterValues values;
+        for (size_t counterIdx = 0; counterIdx < RenderCounterCount; ++counterIdx) {
+            values[counterIdx] = m_Threads[threadId].values[counterIdx].load(std::memory_order_relaxed);
+        }
+        return values;
+    }
+
+    // \return The sum of the counters of all threads
+    RenderCounterValues total() const
+    {
+        RenderCounterValues values = {};
+        for (size_t threadId = 0; threadId < threadCount(); ++threadId) {
+            const auto thread = threadValues(threadId);
+            for (size_t counterIdx = 0; counterIdx < RenderCounterCount; ++counterIdx) {
+                values[counterIdx] += thread[counterIdx];
+            }
+        }
+        return values;
+    }
+
+    // Write the counters as a JSON object: { "total": { "<counter name>": value, ... }, "threads": [ { ... }, ... ] }
+    void writeJson(std::ostream & out) const
+    {
+        const auto writeValues = [&out](const RenderCounterValues & values)
+        {
+            out << "{ ";
+            for (size_t counterIdx = 0; counterIdx < RenderCounterCount; ++counterIdx) {
+                out << (counterIdx ? ", " : "") << '"' << renderCounterName(RenderCounter(counterIdx)) << "\": " << values[counterIdx];
+            }
+            out << " }";
+        };
+
+        out << "{\n  \"total\": ";
+        writeValues(total());
+        out << ",\n  \"threads\": [";
+        for (size_t threadId = 0; threadId < threadCount(); ++threadId) {
+            out << (threadId ? ",\n    " : "\n    ");
+            writeValues(threadValues(threadId));
+        }
+        out << "\n  ]\n}\n";
+    }
+
+private:
+    static const size_t s_CacheLineSize = 64;
+
+    // std::vector does not align its elements on cache lines before C++17: the padding keeps the counters of two threads on distinct lines
+    struct ThreadCounters
+    {
+        std::array<std::atomic_uint64_t, RenderCounterCount> values;
+        char padding[s_CacheLineSize];
+    };
+
+    std::vector<ThreadCounters> m_Threads;
+};
+
+// Add the time spent in a scope to a counter. Does nothing without counters.
+class RenderCounterTimer
+{
+public:
+    // \arg scale Factor of the time added to the counter, e.g. when only some of the scopes of a kind are timed
+    RenderCounterTimer(RenderCounters * counters, size_t threadId, RenderCounter counter, uint64_t scale = 1) :
+        m_pCounters(counters), m_nThreadId(threadId), m_Counter(counter), m_nScale(scale),
+        m_Start(counters ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{})
+    {
+    }
+
+    ~RenderCounterTimer()
+    {
+        if (m_pCounters) {
+            m_pCounters->add(m_nThreadId, m_Counter, m_nScale * std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Start).count());
+        }
+    }
+
+    RenderCounterTimer(const RenderCounterTimer &) = delete;
+    RenderCounterTimer & operator =(const RenderCounterTimer &) = delete;
+
+private:
+    RenderCounters * m_pCounters;
+    size_t m_nThreadId;
+    RenderCounter m_Counter;
+    uint64_t m_nScale;
+    std::chrono::steady_clock::time_point m_Start;
+};
+
+}
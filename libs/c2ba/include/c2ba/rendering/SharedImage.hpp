@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+
+#include "PixelFormat.hpp"
+
+namespace c2ba
+{
+
+// Header of the shared memory segment where TileRenderer::setSharedImage() publishes its images, for other processes to map read only
+// with SharedMemory::openReadOnly(). The three buffered images of the renderer follow the header, in the pixel format of the renderer.
+// Frames are published by bake(): use readSharedImageFrame() to get the last one.
+struct SharedImageHeader
+{
+    static constexpr uint32_t Magic = 0x41423243; // "C2BA"
+    static constexpr uint32_t Version = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    std::atomic_uint32_t isValid; // 0 once the renderer has replaced or removed the segment, consumers must map it again
+    uint32_t pixelFormat; // PixelFormat of the images
+    uint32_t imageWidth;
+    uint32_t imageHeight;
+    uint64_t imageByteSize;
+    uint64_t imageOffsets[3]; // In bytes from the start of the segment
+
+    // Last published frame, guarded by sequence: odd while the renderer updates the fields below
+    std::atomic_uint32_t sequence;
+    uint32_t frontImage; // Index of the published image in imageOffsets
+    uint32_t epoch; // Changes each time the camera moves or the image is cleared
+    uint32_t tileCount;
+    uint64_t frameCount; // Number of frames published since the segment has been created
+    uint64_t tileSampleCount; // Samples of tiles rendered in this epoch, divided by tileCount gives the mean number of samples per pixel
+};
+
+static_assert(sizeof(std::atomic_uint32_t) == sizeof(uint32_t), "Shared atomics must have the layout of their value");
+
+struct SharedImageFrame
+{
+    const void * pixels;
+    PixelFormat format;
+    uint32_t imageWidth;
+    uint32_t imageHeight;
+    uint32_t epoch;
+    uint32_t tileCount;
+    uint64_t frameCount;
+    uint64_t tileSampleCount;
+};
+
+// \return The size of a segment for images of imageByteSize bytes
+inline size_t sharedImageByteSize(size_t imageByteSize)
+{
+    return sizeof(SharedImageHeader) + 3 * imageByteSize;
+}
+
+// Initialize the header of a zeroed segment of sharedImageByteSize() bytes
+inline void initSharedImageHeader(void * segment, PixelFormat format, size_t imageWidth, size_t imageHeight, size_t imageByteSize)
+{
+    auto & header = *(SharedImageHeader *)segment;
+    header.magic = SharedImageHeader::Magic;
+    header.version = SharedImageHeader::Version;
+    header.pixelFormat = uint32_t(format);
+    header.imageWidth = uint32_t(imageWidth);
+    header.imageHeight = uint32_t(imageHeight);
+    header.imageByteSize = imageByteSize;
+    for (size_t imageIdx = 0; imageIdx < 3; ++imageIdx) {
+        header.imageOffsets[imageIdx] = sizeof(SharedImageHeader) + imageIdx * imageByteSize;
+    }
+    header.isValid.store(1, std::memory_order_release);
+}
+
+// Publish a frame, called by the renderer
+inline void writeSharedImageFrame(void * segment, uint32_t frontImage, uint32_t epoch, uint32_t tileCount, uint64_t tileSampleCount)
+{
+    auto & header = *(SharedImageHeader *)segment;
+    const auto sequence = header.sequence.load(std::memory_order_relaxed);
+    header.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header.frontImage = frontImage;
+    header.epoch = epoch;
+    header.tileCount = tileCount;
+    header.tileSampleCount = tileSampleCount;
+    ++header.frameCount;
+    header.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// Read the last frame published in a segment, without copying its pixels. While the renderer is running, the pixels of a frame are not written
+// before frame frameCount + 2 is published: consumers must check with isSharedImageFrameIntact() that the pixels they have read are intact.
+//
+// \arg maxAttempts Reads of the header before giving up, yielding between them while a frame is being published. A publication only takes
+//  a few stores, so they are only exhausted if the renderer died while publishing.
+//
+// \return false if the segment is not valid anymore, if no frame has been published yet or if no consistent frame could be read
+inline bool readSharedImageFrame(const void * segment, SharedImageFrame & frame, uint32_t maxAttempts = 1024)
+{
+    const auto & header = *(const SharedImageHeader *)segment;
+    if (header.magic != SharedImageHeader::Magic || header.version != SharedImageHeader::Version || !header.isValid.load(std::memory_order_acquire)) {
+        return false;
+    }
+    for (uint32_t attempt = 0; attempt < maxAttempts; ++attempt) {
+        const auto sequence = header.sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            std::this_thread::yield(); // Being published
+            continue;
+        }
+        frame.pixels = (const char *)segment + header.imageOffsets[header.frontImage % 3]; // Possibly torn, checked below
+        frame.format = PixelFormat(header.pixelFormat);
+        frame.imageWidth = header.imageWidth;
+        frame.imageHeight = header.imageHeight;
+        frame.epoch = header.epoch;
+        frame.tileCount = header.tileCount;
+        frame.frameCount = header.frameCount;
+        frame.tileSampleCount = header.tileSampleCount;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header.sequence.load(std::memory_order_relaxed) == sequence) {
+            return frame.frameCount > 0;
+        }
+    }
+    return false;
+}
+
+// \return true if the pixels of a frame returned by readSharedImageFrame() have not been overwritten yet
+inline bool isSharedImageFrameIntact(const void * segment, const SharedImageFrame & frame)
+{
+    std::atomic_thread_fence(std::memory_order_acquire); // Reads of the pixels happen before
+    SharedImageFrame lastFrame;
+    return readSharedImageFrame(segment, lastFrame) && lastFrame.frameCount < frame.frameCount + 2;
+}
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace c2ba
+{
+
+// Order of the pixels of a tile in the framebuffer and in the ray buffers of the integrators
+enum class TilePixelLayout
+{
+    RowMajor, // pixelId = x + y * countX
+    Morton // Z-order curve: neighbouring pixels in the image are neighbours in the ray stream
+};
+
+// Interleave the lower 16 bits of value with zeros
+inline uint32_t spreadBits(uint32_t value)
+{
+    value &= 0xFFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+inline uint32_t mortonCode(uint32_t x, uint32_t y)
+{
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+inline uint32_t packPixelCoords(uint32_t x, uint32_t y)
+{
+    return x | (y << 16);
+}
+
+// Pixels of a tile of a given size, in the order of a layout
+struct TilePixelOrder
+{
+    std::vector<uint32_t> coords; // Tile coordinates of each pixel, packed with packPixelCoords()
+    std::vector<uint32_t> indices; // Index in the order of each pixel taken in row major order
+
+    TilePixelOrder() = default;
+
+    // Pixels of partial tiles are sorted by their Morton code, so that the order stays compact and spatially coherent for any tile size
+    TilePixelOrder(size_t countX, size_t countY) :
+        coords(countX * countY), indices(countX * countY)
+    {
+        for (size_t y = 0; y < countY; ++y) {
+            for (size_t x = 0; x < countX; ++x) {
+                coords[x + y * countX] = packPixelCoords(uint32_t(x), uint32_t(y));
+            }
+        }
+        std::sort(begin(coords), end(coords), [](uint32_t lhs, uint32_t rhs)
+        {
+            return mortonCode(lhs & 0xFFFF, lhs >> 16) < mortonCode(rhs & 0xFFFF, rhs >> 16);
+        });
+        for (size_t pixelIdx = 0; pixelIdx < coords.size(); ++pixelIdx) {
+            indices[(coords[pixelIdx] & 0xFFFF) + (coords[pixelIdx] >> 16) * countX] = uint32_t(pixelIdx);
+        }
+    }
+};
+
+}
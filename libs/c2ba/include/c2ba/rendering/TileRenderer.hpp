@@ -2,13 +2,24 @@
 
 #include <thread>
 #include <vector>
+#include <array>
 #include <random>
 #include <numeric>
 #include <atomic>
+#include <chrono>
 
 #include "c2ba/scene/Scene.hpp"
 #include "c2ba/threads.hpp"
+#include "c2ba/utils.hpp"
+#include "c2ba/Trace.hpp"
 #include "TiledFramebuffer.hpp"
+#include "RenderCheckpoint.hpp"
+#include "ExrTileWriter.hpp"
+#include "SharedImage.hpp"
+#include "c2ba/SharedMemory.hpp"
+#include "TileSizeAutotuner.hpp"
+#include "TileScheduler.hpp"
+#include "RenderCounters.hpp"
 #include "integrators/Integrator.hpp"
 #include "integrators/AOIntegrator.hpp"
 #include "integrators/GeometryIntegrator.hpp"
@@ -16,83 +27,530 @@
 namespace c2ba
 {
 
-class TileRenderer
+// \tparam TileStorage Storage policy of the accumulated pixels, see TileStorage.hpp
+template<typename TileStorage = Float4TileStorage>
+class BasicTileRenderer
 {
 public:
-    ~TileRenderer()
+    using Framebuffer = BasicTiledFramebuffer<TileStorage>;
+
+    ~BasicTileRenderer()
     {
         stop();
+        closeSharedImage();
+    }
+
+    // Replace the integrator, an AOIntegrator by default. Must be called while stopped, before the other setters: the integrator holds the scene,
+    // the camera and the framebuffer size.
+    void setIntegrator(std::unique_ptr<Integrator> integrator)
+    {
+        m_Integrator = std::move(integrator);
+        updateIntegratorSampling();
+        m_Dirty = true;
+    }
+
+    // Deterministic mode: each sample depends only on its pixel, its index and the seed, see Integrator::setDeterministic(). Images rendered with
+    // renderSamples() or renderToExr() are then bit identical for the same number of samples whatever the thread count and the tile size,
+    // e.g. to compare images before and after an optimization. The shuffle of the tile scheduler is seeded too. Must be called while stopped.
+    // Checkpointed renders always sample deterministically, see setCheckpoint().
+    void setDeterministic(bool isDeterministic, uint32_t seed = 0)
+    {
+        m_bDeterministic = isDeterministic;
+        m_nSeed = seed;
+        updateIntegratorSampling();
+        m_Dirty = true;
+    }
+
+    bool isDeterministic() const
+    {
+        return m_bDeterministic;
+    }
+
+    uint32_t seed() const
+    {
+        return m_nSeed;
     }
 
     void setScene(const Scene & scene)
     {
         m_Integrator->setScene(scene); // Not really good, we must stop render threads before changing the scene
+        restartTileSizeAutotuner(std::max(m_Framebuffer.imageWidth(), m_Framebuffer.imageHeight()));
         m_Dirty = true;
     }
 
     void setFramebuffer(size_t fbWidth, size_t fbHeight)
     {
-        m_Framebuffer = TiledFramebuffer(s_TileSize, fbWidth, fbHeight);
-        m_Image.resize(fbWidth * fbHeight);
+        m_Integrator->setFramebufferSize(fbWidth, fbHeight);
 
-        m_TilePermutation.resize(m_Framebuffer.tileCount());
-        std::iota(begin(m_TilePermutation), end(m_TilePermutation), 0u);
+        restartTileSizeAutotuner(std::max(fbWidth, fbHeight));
+        resetTiles(targetTileSize(), fbWidth, fbHeight);
+        m_Dirty = true;
+    }
 
-        m_TileSampleCount.resize(m_Framebuffer.tileCount());
-        std::fill(begin(m_TileSampleCount), end(m_TileSampleCount), 0);
+    // Use a fixed tile size, e.g. for benchmarking. 0 enables the autotuning of the tile size (default): the throughput of each candidate size is
+    // measured while rendering, and the next candidate replaces the tiles only when the image is cleared anyway, e.g. by a camera move or renderSamples().
+    // While a checkpoint is set, its tile size is used instead.
+    void setTileSize(size_t tileSize)
+    {
+        m_FixedTileSize = tileSize;
+        restartTileSizeAutotuner(std::max(m_Framebuffer.imageWidth(), m_Framebuffer.imageHeight()));
+        m_Dirty = true;
+    }
 
-        std::random_device rd;
-        std::mt19937 g{ rd() };
+    size_t tileSize() const
+    {
+        return m_TileSize;
+    }
 
-        std::shuffle(begin(m_TilePermutation), end(m_TilePermutation), g);
+    // Store the tiled framebuffer in a checkpoint file, so that the render can be resumed by another process, empty to store it in memory.
+    // Must be called while stopped, after setFramebuffer(). If the file is the checkpoint of a render with the same image size, AOVs, pixel layout
+    // and tile storage, its tiles are resumed at the next bake(): the scene and camera must be the ones of the checkpointed render.
+    // While it is set, the tile size is the one of the checkpoint, or the current one for a new checkpoint.
+    //
+    // Checkpointed renders sample deterministically with the seed of the checkpoint, seed() for a new one: the samples of a tile only depend
+    // on their pixel and index, so that a render resumed after a crash or with another thread count continues exactly where its tiles stopped.
+    //
+    // \return false if the file exists and is not a checkpoint, which is left untouched, or if it cannot be mapped.
+    // The framebuffer is then stored in memory.
+    bool setCheckpoint(const std::string & path)
+    {
+        m_CheckpointPath = path;
+        m_CheckpointTileSize = 0;
+        if (!path.empty()) {
+            RenderCheckpoint::Config config;
+            if (RenderCheckpoint::readConfig(path, config) && config.imageWidth == m_Framebuffer.imageWidth() && config.imageHeight == m_Framebuffer.imageHeight()) {
+                m_CheckpointTileSize = config.tileSize;
+            }
+            else {
+                m_CheckpointTileSize = m_FixedTileSize ? m_FixedTileSize : m_TileSize; // Changing the tile size discards the checkpoint
+            }
+        }
+        resetTiles(targetTileSize(), m_Framebuffer.imageWidth(), m_Framebuffer.imageHeight());
+        m_Dirty = true;
+        if (!path.empty() && !m_Checkpoint.isOpen()) {
+            m_CheckpointPath.clear();
+            m_CheckpointTileSize = 0;
+            return false;
+        }
+        return true;
+    }
 
-        m_Integrator->setFramebufferSize(fbWidth, fbHeight);
+    const std::string & checkpointPath() const
+    {
+        return m_CheckpointPath;
+    }
+
+    // Wait for the tiles rendered so far to reach the disk. They reach the file as they are rendered and survive the process being killed,
+    // this only protects them from a crash of the system.
+    //
+    // \return false if there is no checkpoint or if the writes failed
+    bool syncCheckpoint()
+    {
+        return m_Checkpoint.isOpen() && m_Checkpoint.flush();
+    }
+
+    // Render a number of samples per pixel with all render threads and return once they are done, e.g. for batch renders. Must be called while stopped.
+    // The image is cleared first, except the tiles resumed from a checkpoint which only get their missing samples. The image returned by getPixels()
+    // is resolved on return.
+    void renderSamples(size_t sampleCount)
+    {
+        if (needsTileReset()) {
+            resetTiles(targetTileSize(), m_Framebuffer.imageWidth(), m_Framebuffer.imageHeight());
+        }
+        clear();
+        resumeCheckpointTiles();
+
+        m_ThreadCount = batchThreadCount();
+        m_Counters.reset(m_ThreadCount);
+        preprocess();
+        const uint32_t epoch = m_Epoch;
+
+        // Tiles are rendered to completion one after the other, so that the image is finished tile by tile
+        syncParallelLoop(uint32_t(m_Framebuffer.tileCount()), ParallelLoopOptions{ ParallelSchedule::Dynamic, 1, m_ThreadCount }, [&](uint32_t tileId, uint32_t threadId)
+        {
+            if (m_Framebuffer.acquireTile(tileId, epoch)) {
+                m_TileSampleCount[tileId] = 0;
+            }
+            if (m_TileSampleCount[tileId] >= sampleCount) {
+                return;
+            }
+            const TraceScope trace("tile", "tile", tileId);
+
+            std::vector<float> tileLuminance(m_Framebuffer.tilePixelCount());
+            std::vector<float4> tileScratch(TileStorage::IsDirect ? 0 : m_Framebuffer.tilePixelCount());
+            const auto tilePtr = m_Framebuffer.loadTile(tileId, tileScratch.data());
+            auto params = tileRenderParams(m_Framebuffer, tileId, threadId, tilePtr);
+            params.tileEpoch = epoch;
+            params.counters = &m_Counters;
+
+            while (m_TileSampleCount[tileId] < sampleCount)
+            {
+                params.startSample = m_TileSampleCount[tileId];
+                m_Framebuffer.storeTileLuminance(tilePtr, tileLuminance.data());
+
+                const auto renderStart = std::chrono::steady_clock::now();
+                m_Integrator->render(params);
+                const auto renderTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - renderStart).count();
+                m_Counters.add(threadId, RenderCounter::RenderTime, renderTime);
+                m_Counters.add(threadId, RenderCounter::TilePasses, 1);
+
+                m_Framebuffer.accumulateLuminanceSquares(tileId, tilePtr, tileLuminance.data());
+                m_Framebuffer.commitTile(tileId);
+                ++m_TileSampleCount[tileId];
+                m_TileScheduler.reportTile(tileId, epoch, m_TileSampleCount[tileId], m_Framebuffer.estimateTileError(tileId, tilePtr), float(renderTime));
+                ++m_TotalRenderedTileCount;
+                ++m_RenderedTileCount;
+            }
+
+            m_Framebuffer.storeTile(tileId, tilePtr);
+        });
+        m_ThreadCount = 0;
+
+        if (m_Checkpoint.isOpen()) {
+            m_Checkpoint.flush();
+        }
+        bake(); // Resolves the image, the renderer being stopped
+    }
+
+    // Render an image of any size to a tiled OpenEXR file, without the tiled framebuffer of the renderer: only a row of tiles is rendered at a time
+    // and two rows of pixels are held in memory, one being filled while the previous one is compressed and written, so that the resolution is
+    // bounded by the disk rather than the RAM. Uses the scene, camera, tile size, pixel layout, AOVs and thread count of the renderer.
+    // Must be called while stopped. Throws if the file cannot be written.
+    //
+    // \arg sampleCount Samples of each pixel
+    void renderToExr(const std::string & path, size_t imageWidth, size_t imageHeight, size_t sampleCount, ExrCompression compression = ExrCompression::Zip)
+    {
+        const auto tileSize = targetTileSize();
+        const auto threadCount = batchThreadCount();
+        // A row is compressed while the next one is rendered by threadCount threads: the compression gets a small share of the cores
+        ExrTileWriter writer(path, imageWidth, imageHeight, tileSize, m_AOVs, compression, std::max(1u, threadCount / 4));
+
+        m_Integrator->setFramebufferSize(imageWidth, imageHeight);
+        m_Integrator->setTileSize(tileSize);
+        m_Integrator->setThreadCount(threadCount);
+        m_Integrator->preprocess();
+        m_Counters.reset(threadCount);
+        const auto restoreIntegrator = finally([&]()
+        {
+            m_Integrator->setFramebufferSize(m_Framebuffer.imageWidth(), m_Framebuffer.imageHeight());
+            m_Dirty = true; // Preprocessed again by the next start()
+        });
+
+        Framebuffer rowTiles;
+        std::vector<float4> rowPixels[2];
+        std::array<std::vector<float>, AOVCount> rowAOVs[2];
+        std::future<void> pendingWrite;
+
+        for (size_t tileY = 0; tileY < writer.tileCountY(); ++tileY) {
+            // Rows of the file go from top to bottom, the ones of the image from bottom to top
+            const auto rowHeight = std::min(tileSize, imageHeight - tileY * tileSize);
+            const auto beginY = imageHeight - tileY * tileSize - rowHeight;
+            if (rowTiles.imageHeight() != rowHeight) {
+                rowTiles = Framebuffer(tileSize, imageWidth, rowHeight, m_TilePixelLayout, m_AOVs);
+            }
+            rowTiles.clear(); // Tiles of the previous row are cleared when acquired
+
+            syncParallelLoop(uint32_t(rowTiles.tileCount()), ParallelLoopOptions{ ParallelSchedule::Dynamic, 1, threadCount }, [&](uint32_t tileIdx, uint32_t threadId)
+            {
+                const TraceScope trace("tile", "tile", tileIdx + tileY * rowTiles.tileCountX());
+                std::vector<float4> tileScratch(TileStorage::IsDirect ? 0 : rowTiles.tilePixelCount());
+                rowTiles.acquireTile(tileIdx, 0);
+                const auto tilePtr = rowTiles.loadTile(tileIdx, tileScratch.data());
+
+                auto params = tileRenderParams(rowTiles, tileIdx, threadId, tilePtr);
+                params.tileId = tileIdx + tileY * rowTiles.tileCountX();
+                params.beginY += beginY;
+                params.counters = &m_Counters;
+
+                for (size_t sampleIdx = 0; sampleIdx < sampleCount; ++sampleIdx) {
+                    params.startSample = sampleIdx;
+                    {
+                        const RenderCounterTimer timer(&m_Counters, threadId, RenderCounter::RenderTime);
+                        m_Integrator->render(params);
+                    }
+                    m_Counters.add(threadId, RenderCounter::TilePasses, 1);
+                }
+                rowTiles.storeTile(tileIdx, tilePtr);
+            });
+
+            // The other buffer is still being written
+            auto & pixels = rowPixels[tileY % 2];
+            auto & aovs = rowAOVs[tileY % 2];
+            pixels.resize(rowTiles.pixelCount());
+            rowTiles.copy(pixels.data());
+            for (auto & pixel : pixels) {
+                if (pixel.w > 0.f) {
+                    pixel /= pixel.w;
+                }
+            }
+            flipRows(pixels.data(), imageWidth, rowHeight);
+            AOVImages aovImages = {};
+            for (size_t aovIdx = 0; aovIdx < AOVCount; ++aovIdx) {
+                if (hasAOV(m_AOVs, AOV(aovIdx))) {
+                    const auto componentCount = aovComponentCount(AOV(aovIdx));
+                    aovs[aovIdx].resize(rowTiles.pixelCount() * componentCount);
+                    rowTiles.copyAOV(AOV(aovIdx), aovs[aovIdx].data());
+                    flipRows(aovs[aovIdx].data(), imageWidth * componentCount, rowHeight);
+                    aovImages[aovIdx] = aovs[aovIdx].data();
+                }
+            }
+
+            if (pendingWrite.valid()) {
+                pendingWrite.get(); // Rethrows the errors of the writer
+            }
+            pendingWrite = std::async(std::launch::async, [&writer, tileY, &pixels, aovImages]()
+            {
+                writer.writeTileRow(tileY, pixels.data(), aovImages);
+            });
+        }
+
+        if (pendingWrite.valid()) {
+            pendingWrite.get();
+        }
+    }
+
+    // Order of the pixels of the tiles, in the framebuffer and in the ray streams of the integrators. Row major by default.
+    // Takes effect at the next bake().
+    void setTilePixelLayout(TilePixelLayout layout)
+    {
+        m_TilePixelLayout = layout;
         m_Dirty = true;
     }
 
+    TilePixelLayout tilePixelLayout() const
+    {
+        return m_TilePixelLayout;
+    }
+
+    // AOVs written by the integrator next to the color, as a set of aovBit(). None by default. Takes effect at the next bake().
+    void setAOVs(AOVSet aovs)
+    {
+        m_AOVs = aovs;
+        m_Dirty = true;
+    }
+
+    AOVSet aovs() const
+    {
+        return m_AOVs;
+    }
+
+    bool isTuningTileSize() const
+    {
+        return !m_FixedTileSize && !m_CheckpointTileSize && m_TileSizeAutotuner.isTuning();
+    }
+
+    const TileSizeAutotuner & tileSizeAutotuner() const
+    {
+        return m_TileSizeAutotuner;
+    }
+
+    // Tiles whose estimated relative error is below the target are not rendered anymore, until the whole image reaches the target.
+    // 0 (default) keeps refining all noisy tiles, noisier tiles first. Can be called while rendering.
+    void setTargetError(float error)
+    {
+        m_TileScheduler.setTargetError(error);
+    }
+
+    float targetError() const
+    {
+        return m_TileScheduler.targetError();
+    }
+
+    // \return true if all tiles have reached the target error
+    bool isConverged() const
+    {
+        return m_TileScheduler.isConverged();
+    }
+
+    size_t convergedTileCount() const
+    {
+        return m_TileScheduler.convergedTileCount();
+    }
+
+    size_t tileCount() const
+    {
+        return m_Framebuffer.tileCount();
+    }
+
+    // Camera changes do not pause the render threads: they start a new epoch, tiles of the previous epoch are abandoned
+    // between two ray batches and lazily cleared when they are rendered again.
     void setProjMatrix(const float4x4 & projMatrix)
     {
         m_Integrator->setProjMatrix(projMatrix);
-        m_Dirty = true;
+        nextEpoch();
     }
 
     void setViewMatrix(const float4x4 & viewMatrix)
     {
         m_Integrator->setViewMatrix(viewMatrix);
-        m_Dirty = true;
+        nextEpoch();
+    }
+
+    // Render in frames of fixed duration, 0 (default) disables the budget. Can be called while rendering.
+    // Render threads only start tile passes that are predicted to end before the deadline of the current frame, with as many samples as fit,
+    // and bake() waits for the deadline, has the render threads resolve the tiles of the frame, publishes that image and starts the next frame.
+    void setFrameBudget(float milliseconds)
+    {
+        m_FrameBudget = int64_t(milliseconds * 1e6f);
+        startFrame();
     }
 
+    float frameBudget() const
+    {
+        return m_FrameBudget * 1e-6f;
+    }
+
+    struct FrameStats
+    {
+        float budgetUsage; // Fraction of the frame budget spent rendering by the render threads, above 1 if passes ended after the deadline
+        float frameMilliseconds; // Time between the two last frame starts
+        uint64_t sampleCount; // Tile samples rendered during the frame
+        float publishLatencyMilliseconds; // Time between the deadline and the publication of the image of the frame, its resolve included
+    };
+
+    // \return Statistics of the last frame completed by bake() with a frame budget
+    FrameStats lastFrameStats() const
+    {
+        std::unique_lock<std::mutex> l{ m_PauseMutex };
+        return m_LastFrameStats;
+    }
+
+    // Format of the images returned by getPixels(), RGBA32F by default. Can be called while rendering, takes effect at the next bake().
+    void setPixelFormat(PixelFormat format)
+    {
+        m_PixelFormat = format;
+        m_bImagesDirty = true;
+    }
+
+    PixelFormat pixelFormat() const
+    {
+        return m_PixelFormat;
+    }
+
+    // Exposure in stops applied by display pixel formats, 0 by default. Can be called while rendering, takes effect at the next bake().
+    void setExposure(float exposure)
+    {
+        m_Exposure = exposure;
+        m_bImagesDirty = true;
+    }
+
+    float exposure() const
+    {
+        return m_Exposure;
+    }
+
+    // Number of render threads, clamped to the number of workers of the global thread pool. 0 means all workers.
+    // start() leaves one worker to the other tasks of the pool, see getLongRunningThreadCount(): it renders with all workers but one at most.
+    // Takes effect at the next start() from the stopped state.
+    void setThreadCount(uint32_t threadCount)
+    {
+        m_RequestedThreadCount = threadCount;
+    }
+
+    // \return The number of threads of renderSamples() and renderToExr(), which run on the calling thread and all workers
+    uint32_t batchThreadCount() const
+    {
+        return m_RequestedThreadCount ? std::min(m_RequestedThreadCount, getThreadCount()) : getThreadCount();
+    }
+
+    // Tiles are cleared lazily, images are updated by the next resolves
     void clear()
     {
-        fill(begin(m_Image), end(m_Image), float4(0));
+        std::atomic_store(&m_ResolvePass, std::shared_ptr<ResolvePass>()); // Its tiles are about to be stale
         m_Framebuffer.clear();
         m_Dirty = false;
-        m_NextTile = 0;
+        m_TileScheduler.reset(m_Framebuffer.tileCount());
+        if (m_bDeterministic) {
+            m_TileScheduler.seed(m_nSeed);
+        }
+        m_RenderedTileCount = 0;
     }
 
-    // Bake rendered tiled framebuffer to contiguously allocated image
+    // Publish the last image resolved from the tiled framebuffer and ask the render threads to resolve the next one.
+    // The image is triple buffered: render threads resolve tiles into a back image, and bake() only swaps it with the front image
+    // returned by getPixels() once it is complete, one bake() later. With a frame budget, bake() instead waits for the image resolved
+    // at the deadline of the frame and publishes it at once. When the renderer is paused or stopped, the tiles are copied by the calling thread,
+    // to a buffered image too: the image written is never one of the last two published, see isSharedImageFrameIntact().
     void bake()
     {
         if (m_bStopped || m_bPaused)
         {
             if (m_Dirty) {
+                if (needsTileReset()) {
+                    resetTiles(targetTileSize(), m_Framebuffer.imageWidth(), m_Framebuffer.imageHeight());
+                }
                 clear();
+                resumeCheckpointTiles();
+            }
+            if (m_bImagesDirty) {
+                resetImages();
+            }
+            // The image published before the front one is the ready one, or the back one if a resolve pass has been completed since
+            std::atomic_store(&m_ResolvePass, std::shared_ptr<ResolvePass>()); // Its back image may be written here
+            const auto previousFrontImage = m_bNewImage ? m_BackImage : m_ReadyImage;
+            const auto outImage = 3 - m_FrontImage - previousFrontImage;
+
+            // Tiles of a previous epoch are displayed empty
+            const auto aovImages = aovImagePtrs(outImage);
+            m_Framebuffer.resolve(m_ImageData[outImage], m_Epoch, m_ImageGenerations[outImage].data(), m_PixelFormat, exposureScale(), &aovImages);
+            {
+                std::unique_lock<std::mutex> l{ m_ImageMutex };
+                m_ReadyImage = m_FrontImage;
+                m_BackImage = previousFrontImage;
+                m_FrontImage = outImage;
+                m_bNewImage = false;
             }
+            publishSharedImage();
             return;
         }
 
+        if (m_FrameBudget) {
+            // Render threads do not start passes ending after the deadline: once it is reached the image is complete for this frame
+            std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(m_FrameDeadline.load())));
+        }
+
+        const bool restart = m_Dirty || m_bImagesDirty;
         if (m_Dirty) {
             pause();
+            if (needsTileReset()) {
+                resetTiles(targetTileSize(), m_Framebuffer.imageWidth(), m_Framebuffer.imageHeight());
+            }
             clear();
-
-            m_Integrator->setTileSize(s_TileSize);
-            m_Integrator->setThreadCount(m_ThreadCount);
-            m_Integrator->preprocess();
-
+            resumeCheckpointTiles();
+            if (m_bImagesDirty) {
+                resetImages();
+            }
+            preprocess();
+            start();
+        }
+        else if (m_bImagesDirty) {
+            pause(); // Render threads write to the back image
+            resetImages();
             start();
         }
+        else if (isTuningTileSize()) {
+            updateTileSizeAutotuner();
+        }
+        if (m_FrameBudget && !restart) {
+            resolveFrame();
+        }
 
-        m_Framebuffer.copy(m_Image.data());
+        {
+            std::unique_lock<std::mutex> l{ m_ImageMutex };
+            if (m_bNewImage) {
+                std::swap(m_FrontImage, m_ReadyImage);
+                m_bNewImage = false;
+                publishSharedImage();
+            }
+        }
+
+        if (m_FrameBudget) {
+            endFrame(steadyNow() - m_FrameDeadline);
+            startFrame();
+        }
+        else {
+            requestResolve();
+        }
     }
 
     // Start the rendering if a scene has been set and the renderer is stopped or paused.
@@ -105,18 +563,31 @@ public:
         {
             m_bStopped = false;
             m_bPaused = false;
-            m_ThreadCount = getHardwareConcurrency() > 1u ? getHardwareConcurrency() - 1u : 1u; // Try to keep one thread for the main loop
+            m_TotalRenderedTileCount = 0;
+            m_CanceledTileCount = 0;
+            m_ContendedTileCount = 0;
+            m_SplitTileCount = 0;
+            // Render tasks loop until stop() and pause() waits for all of them, so they must all run at the same time on the pool.
+            // One worker is left to the other tasks of the pool, which would otherwise wait for stop().
+            const auto maxThreadCount = getLongRunningThreadCount();
+            m_ThreadCount = m_RequestedThreadCount ? std::min(m_RequestedThreadCount, maxThreadCount) : maxThreadCount;
+            m_Counters.reset(m_ThreadCount);
+            m_TileScheduler.setThreadCount(m_ThreadCount);
 
-            m_Integrator->setTileSize(s_TileSize);
-            m_Integrator->setThreadCount(m_ThreadCount);
-            m_Integrator->preprocess();
+            preprocess();
 
+            startFrame();
             m_RenderTaskFuture = asyncParallelRun(m_ThreadCount, [this](size_t threadId) { renderTask(threadId); });
         }
         else if (m_bPaused)
         {
-            m_bPaused = false;
-            m_PausedThreadCount = 0;
+            startFrame();
+            {
+                std::unique_lock<std::mutex> l{ m_PauseMutex };
+                m_bPaused = false;
+                m_PausedThreadCount = 0;
+                ++m_ResumeCount;
+            }
             m_UnpauseCondition.notify_all();
         }
 
@@ -124,71 +595,718 @@ public:
     }
 
     // All threads wait for the next call to start() to resume rendering.
-    // The method waits for all threads to be in the waiting state
+    // The method waits for all threads to be in the waiting state: it returns as soon as the last thread finishes its current tile.
     void pause()
     {
         if (m_bPaused || m_bStopped)
             return;
 
+        std::unique_lock<std::mutex> l{ m_PauseMutex };
         m_PausedThreadCount = 0;
         m_bPaused = true;
-        while (m_PausedThreadCount != m_ThreadCount) // Wait for all threads to increment the counter
-        {
-            std::this_thread::sleep_for(std::chrono::milliseconds(60));
-        }
+        m_NextFrameCondition.notify_all();
+        m_PausedCondition.wait(l, [this]() { return m_PausedThreadCount == m_ThreadCount; });
     }
 
     // All threads exit their rendering function.
     // The method waits for them.
     void stop()
     {
-        m_bStopped = true;
-        m_bPaused = false;
-        m_PausedThreadCount = 0;
+        {
+            std::unique_lock<std::mutex> l{ m_PauseMutex };
+            m_bStopped = true;
+            m_bPaused = false;
+            m_PausedThreadCount = 0;
+        }
         m_UnpauseCondition.notify_all();
+        m_NextFrameCondition.notify_all();
 
-        m_RenderTaskFuture.wait();
+        if (m_RenderTaskFuture.valid()) {
+            m_RenderTaskFuture.wait();
+        }
         m_ThreadCount = 0;
+        std::atomic_store(&m_ResolvePass, std::shared_ptr<ResolvePass>()); // Abandoned by the render threads
+
+        if (m_Checkpoint.isOpen()) {
+            m_Checkpoint.flush();
+        }
+    }
+
+    // \return The pixels of the last image published by bake(), in the format given by pixelFormat()
+    const void * getPixels() const
+    {
+        return m_ImageData[m_FrontImage];
     }
 
-    const float4 * getPixels() const
+    // Publish the images returned by getPixels() to a named shared memory segment, see SharedImageHeader, so that other processes of the machine
+    // can map them read only and consume them without copy: the images are resolved directly in the segment. Empty (default) to stop publishing.
+    // Can be called while rendering, takes effect at the next bake().
+    void setSharedImage(const std::string & name)
     {
-        return m_Image.data();
+        m_SharedImageName = name;
+        m_bImagesDirty = true;
+    }
+
+    // \return false if no shared image has been set or if its segment could not be created
+    bool isSharingImage() const
+    {
+        return m_SharedImage.isOpen();
+    }
+
+    // \return The pixels of an AOV in the last image published by bake(), aovComponentCount() floats per pixel. nullptr if the AOV is disabled.
+    const float * getAOVPixels(AOV aov) const
+    {
+        const auto & image = m_AOVImages[m_FrontImage][size_t(aov)];
+        return image.empty() ? nullptr : image.data();
+    }
+
+    // \return The number of tiles rendered since the last clear or camera change
+    uint32_t renderedTileCount() const
+    {
+        return m_RenderedTileCount;
+    }
+
+    struct Stats
+    {
+        uint64_t renderedTileCount; // Tile passes completed
+        uint64_t canceledTileCount; // Tile passes abandoned because of a camera change
+        uint64_t contendedTileCount; // Tiles skipped because another thread was rendering them
+        uint64_t splitTileCount; // Tile passes split in bands rendered by multiple threads
+    };
+
+    // \return Counters accumulated since the last start() from the stopped state
+    Stats stats() const
+    {
+        return{ m_TotalRenderedTileCount, m_CanceledTileCount, m_ContendedTileCount, m_SplitTileCount };
+    }
+
+    // \return The counters of each render thread, accumulated since the last start() from the stopped state, renderSamples() or renderToExr().
+    // Can be read while rendering.
+    const RenderCounters & counters() const
+    {
+        return m_Counters;
     }
 
 private:
+    void preprocess()
+    {
+        m_Integrator->setTileSize(m_TileSize);
+        m_Integrator->setThreadCount(m_ThreadCount);
+        m_Integrator->preprocess();
+    }
+
+    // Checkpointed renders sample deterministically with the seed of their checkpoint, see setCheckpoint()
+    void updateIntegratorSampling()
+    {
+        if (m_Checkpoint.isOpen()) {
+            m_Integrator->setDeterministic(true, m_Checkpoint.seed());
+        }
+        else {
+            m_Integrator->setDeterministic(m_bDeterministic, m_nSeed);
+        }
+    }
+
+    // Must be called while render threads are paused or stopped
+    void resetTiles(size_t tileSize, size_t fbWidth, size_t fbHeight)
+    {
+        m_TileSize = tileSize;
+        m_Framebuffer = Framebuffer(); // Releases the memory of the checkpoint before it is mapped again
+        m_Checkpoint.close();
+        m_ResumedTiles.clear();
+
+        void * persistentMemory = nullptr;
+        if (!m_CheckpointPath.empty()) {
+            const RenderCheckpoint::Config config = { uint32_t(sizeof(typename Framebuffer::Texel)), uint32_t(m_TileSize),
+                uint32_t(fbWidth), uint32_t(fbHeight), uint32_t(m_TilePixelLayout), m_AOVs };
+            if (m_Checkpoint.open(m_CheckpointPath, config, Framebuffer::persistentByteSize(m_TileSize, fbWidth, fbHeight, m_AOVs), m_nSeed)) {
+                persistentMemory = m_Checkpoint.framebufferMemory();
+            }
+        }
+        m_Framebuffer = Framebuffer(m_TileSize, fbWidth, fbHeight, m_TilePixelLayout, m_AOVs, persistentMemory);
+
+        if (m_Checkpoint.isResumed()) {
+            // Tiles of the last epoch of the checkpointed render, the others were stale
+            for (size_t tileIdx = 0; tileIdx < m_Framebuffer.tileCount(); ++tileIdx) {
+                if (m_Framebuffer.tileEpoch(tileIdx) == m_Checkpoint.epoch() && m_Framebuffer.storedSampleCount(tileIdx) > 0) {
+                    m_ResumedTiles.emplace_back(tileIdx);
+                }
+            }
+        }
+        if (m_Checkpoint.isOpen()) {
+            m_Checkpoint.setEpoch(m_Epoch);
+        }
+        updateIntegratorSampling();
+
+        m_TileScheduler.reset(m_Framebuffer.tileCount());
+        resetImages(); // Generations are tracked for the previous tiles
+
+        m_TileSampleCount.resize(m_Framebuffer.tileCount());
+        std::fill(begin(m_TileSampleCount), end(m_TileSampleCount), 0);
+
+        m_TunedSampleCount = 0;
+        m_TunedRenderTime = 0;
+    }
+
+    // Must be called while render threads are paused or stopped
+    void resetImages()
+    {
+        std::atomic_store(&m_ResolvePass, std::shared_ptr<ResolvePass>());
+        const auto imageByteSize = m_Framebuffer.pixelCount() * pixelByteSize(m_PixelFormat);
+        if (m_SharedImageName.empty()) {
+            closeSharedImage();
+        }
+        else {
+            openSharedImage(imageByteSize);
+        }
+        for (size_t imageIdx = 0; imageIdx < 3; ++imageIdx) {
+            // Zeros are empty pixels in all formats
+            if (m_SharedImage.isOpen()) {
+                std::vector<uint8_t>().swap(m_Images[imageIdx]);
+                m_ImageData[imageIdx] = (uint8_t *)m_SharedImage.data() + ((const SharedImageHeader *)m_SharedImage.data())->imageOffsets[imageIdx];
+                std::fill(m_ImageData[imageIdx], m_ImageData[imageIdx] + imageByteSize, uint8_t(0));
+            }
+            else {
+                m_Images[imageIdx].assign(imageByteSize, 0);
+                m_ImageData[imageIdx] = m_Images[imageIdx].data();
+            }
+            m_ImageGenerations[imageIdx].assign(m_Framebuffer.tileCount(), Framebuffer::EmptyGeneration);
+            for (size_t aovIdx = 0; aovIdx < AOVCount; ++aovIdx) {
+                auto & aovImage = m_AOVImages[imageIdx][aovIdx];
+                aovImage.clear();
+                if (hasAOV(m_Framebuffer.aovs(), AOV(aovIdx))) {
+                    aovImage.resize(m_Framebuffer.pixelCount() * aovComponentCount(AOV(aovIdx)), 0.f);
+                }
+            }
+        }
+        m_bImagesDirty = false;
+    }
+
+    // Keep the segment of the shared image if it fits the images, otherwise replace it
+    void openSharedImage(size_t imageByteSize)
+    {
+        if (m_SharedImage.isOpen() && m_SharedImage.name() == m_SharedImageName) {
+            const auto & header = *(const SharedImageHeader *)m_SharedImage.data();
+            if (header.pixelFormat == uint32_t(m_PixelFormat) && header.imageWidth == m_Framebuffer.imageWidth() && header.imageHeight == m_Framebuffer.imageHeight()) {
+                return;
+            }
+        }
+        closeSharedImage();
+        if (m_SharedImage.create(m_SharedImageName, sharedImageByteSize(imageByteSize))) {
+            initSharedImageHeader(m_SharedImage.data(), m_PixelFormat, m_Framebuffer.imageWidth(), m_Framebuffer.imageHeight(), imageByteSize);
+        }
+    }
+
+    void closeSharedImage()
+    {
+        if (m_SharedImage.isOpen()) {
+            ((SharedImageHeader *)m_SharedImage.data())->isValid = 0; // Tells consumers still mapping it to map the new segment
+            m_SharedImage.close();
+        }
+    }
+
+    void publishSharedImage()
+    {
+        if (m_SharedImage.isOpen()) {
+            writeSharedImageFrame(m_SharedImage.data(), uint32_t(m_FrontImage), m_Epoch, uint32_t(m_Framebuffer.tileCount()), m_RenderedTileCount);
+        }
+    }
+
+    // \return The AOV images of a buffered image, nullptr for disabled AOVs
+    AOVImages aovImagePtrs(size_t imageIdx)
+    {
+        AOVImages images;
+        for (size_t aovIdx = 0; aovIdx < AOVCount; ++aovIdx) {
+            auto & image = m_AOVImages[imageIdx][aovIdx];
+            images[aovIdx] = image.empty() ? nullptr : image.data();
+        }
+        return images;
+    }
+
+    // Stamp the tiles resumed from the checkpoint with the current epoch and report them to the scheduler.
+    // Must be called after clear(), while render threads are paused or stopped.
+    void resumeCheckpointTiles()
+    {
+        if (m_ResumedTiles.empty()) {
+            return;
+        }
+        std::vector<float4> scratch(m_Framebuffer.tilePixelCount());
+        for (const auto tileIdx : m_ResumedTiles) {
+            m_Framebuffer.restoreTile(tileIdx, m_Epoch);
+            m_TileSampleCount[tileIdx] = m_Framebuffer.storedSampleCount(tileIdx);
+            const auto pixels = m_Framebuffer.loadTile(tileIdx, scratch.data());
+            m_TileScheduler.reportTile(tileIdx, m_Epoch, m_TileSampleCount[tileIdx], m_Framebuffer.estimateTileError(tileIdx, pixels), 0.f);
+        }
+        m_ResumedTiles.clear();
+    }
+
+    bool needsTileReset() const
+    {
+        return targetTileSize() != m_TileSize || m_TilePixelLayout != m_Framebuffer.pixelLayout() || m_AOVs != m_Framebuffer.aovs();
+    }
+
+    float exposureScale() const
+    {
+        return std::exp2(m_Exposure);
+    }
+
+    size_t targetTileSize() const
+    {
+        if (m_CheckpointTileSize) {
+            return m_CheckpointTileSize;
+        }
+        return m_FixedTileSize ? m_FixedTileSize : m_TileSizeAutotuner.tileSize();
+    }
+
+    void restartTileSizeAutotuner(size_t maxTileSize)
+    {
+        std::vector<size_t> candidates;
+        for (const auto tileSize : { 16, 8, 32, 64 }) { // The first candidate is the historical default, used until the first measure
+            if (candidates.empty() || size_t(tileSize) <= maxTileSize) {
+                candidates.emplace_back(tileSize);
+            }
+        }
+        m_TileSizeAutotuner.restart(candidates);
+    }
+
+    // Once a full image worth of samples has been rendered with the current candidate tile size, report its throughput.
+    // The next candidate is not applied here, that would discard the accumulated image: bake() resets the tiles to it at the next clear.
+    void updateTileSizeAutotuner()
+    {
+        if (m_TileSize != m_TileSizeAutotuner.tileSize()) {
+            return; // The current tiles have been measured already
+        }
+        const uint64_t sampleCount = m_TunedSampleCount;
+        if (sampleCount < m_Framebuffer.pixelCount()) {
+            return;
+        }
+
+        m_TileSizeAutotuner.addMeasure(sampleCount, m_TunedRenderTime * 1e-9);
+        m_TunedSampleCount = 0;
+        m_TunedRenderTime = 0;
+    }
+
+    static int64_t steadyNow()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Set the deadline of a new frame and wake up the threads waiting for it
+    void startFrame()
+    {
+        const auto now = steadyNow();
+        const auto budget = m_FrameBudget.load();
+        if (budget && m_ThreadCount) {
+            // Give each tile as many samples per pass as the whole image can get in a frame, so that a round lasts about one frame
+            const auto imageCost = double(m_TileScheduler.meanCost()) * m_Framebuffer.tileCount() / m_ThreadCount;
+            const auto sampleCount = imageCost > 0. ? size_t(budget / imageCost) : size_t(1);
+            m_FrameSampleCount = std::min(std::max(sampleCount, size_t(1)), size_t(s_MaxPassSampleCount));
+        }
+        {
+            std::unique_lock<std::mutex> l{ m_PauseMutex };
+            m_FrameStart = now;
+            m_FrameDeadline = now + budget;
+            ++m_FrameIndex;
+        }
+        m_NextFrameCondition.notify_all();
+    }
+
+    // \arg publishLatency Time between the deadline and the publication of the image of the frame
+    void endFrame(int64_t publishLatency)
+    {
+        const auto now = steadyNow();
+        const auto budget = m_FrameBudget.load();
+
+        std::unique_lock<std::mutex> l{ m_PauseMutex };
+        m_LastFrameStats.budgetUsage = budget && m_ThreadCount ? float(double(m_FrameRenderTime.exchange(0)) / (double(budget) * m_ThreadCount)) : 0.f;
+        m_LastFrameStats.frameMilliseconds = (now - m_FrameStart) * 1e-6f;
+        m_LastFrameStats.sampleCount = m_FrameRenderedSampleCount.exchange(0);
+        m_LastFrameStats.publishLatencyMilliseconds = std::max(publishLatency, int64_t(0)) * 1e-6f;
+    }
+
+    // \return The number of samples to render in the next pass of a tile, 0 if the pass would end after the deadline of the frame
+    size_t passSampleCount(size_t tileId, size_t rowCount) const
+    {
+        if (!m_FrameBudget) {
+            return 1;
+        }
+        const auto sampleCost = m_TileScheduler.predictedCost(tileId) / splitBandCount(tileId, rowCount);
+        if (sampleCost <= 0.f) {
+            return 1; // Nothing rendered yet, the first pass measures the cost
+        }
+        const auto timeLeft = double(m_FrameDeadline - steadyNow());
+        return timeLeft > 0. ? std::min(m_FrameSampleCount.load(), size_t(timeLeft / sampleCost)) : 0;
+    }
+
+    void waitNextFrame(uint32_t frameIndex)
+    {
+        std::unique_lock<std::mutex> l{ m_PauseMutex };
+        m_NextFrameCondition.wait(l, [this, frameIndex]() { return m_FrameIndex != frameIndex || !m_FrameBudget || m_bPaused || m_bStopped || hasResolveWork(); });
+    }
+
+    void nextEpoch()
+    {
+        m_RenderedTileCount = 0;
+        ++m_Epoch;
+        if (m_Checkpoint.isOpen()) {
+            m_Checkpoint.setEpoch(m_Epoch); // Tiles of the previous epoch are stale
+        }
+    }
+
+    // A copy of all tiles to the back image, shared by the render threads
+    struct ResolvePass
+    {
+        void * const outImage;
+        uint32_t * const resolvedGenerations; // Of the tiles in outImage
+        const uint32_t tileCount;
+        const PixelFormat format;
+        const float exposureScale;
+        const AOVImages aovImages;
+        std::atomic_uint32_t nextTile{ 0 };
+        std::atomic_uint32_t doneTileCount{ 0 };
+
+        ResolvePass(void * outImage, uint32_t * resolvedGenerations, uint32_t tileCount, PixelFormat format, float exposureScale, const AOVImages & aovImages) :
+            outImage(outImage), resolvedGenerations(resolvedGenerations), tileCount(tileCount), format(format), exposureScale(exposureScale), aovImages(aovImages)
+        {
+        }
+    };
+
+    // Publish a resolve pass for the render threads, unless the previous one is not finished yet
+    void requestResolve()
+    {
+        if (std::atomic_load(&m_ResolvePass)) {
+            return;
+        }
+        std::atomic_store(&m_ResolvePass, std::make_shared<ResolvePass>(m_ImageData[m_BackImage], m_ImageGenerations[m_BackImage].data(), uint32_t(m_Framebuffer.tileCount()),
+            m_PixelFormat, exposureScale(), aovImagePtrs(m_BackImage)));
+    }
+
+    // \return true if a resolve pass has tiles left to take
+    bool hasResolveWork() const
+    {
+        const auto pass = std::atomic_load(&m_ResolvePass);
+        return pass && pass->nextTile < pass->tileCount;
+    }
+
+    // With a frame budget: have the render threads resolve the tiles rendered during the frame, and wait for the image.
+    // Passes of the frame still running delay the resolve of their tile only.
+    void resolveFrame()
+    {
+        {
+            std::unique_lock<std::mutex> l{ m_PauseMutex }; // Threads waiting for the next frame check for the pass under this lock
+            requestResolve();
+        }
+        m_NextFrameCondition.notify_all();
+
+        std::unique_lock<std::mutex> l{ m_ImageMutex };
+        m_ResolvedCondition.wait(l, [this]() { return m_bNewImage; });
+    }
+
+    // Copy blocks of tiles of a resolve pass until all of them have been taken. The thread copying the last tile publishes the back image.
+    // Only the tiles updated since they were last copied to the back image are copied again.
+    void resolveTiles(ResolvePass & pass, size_t threadId)
+    {
+        const RenderCounterTimer timer(&m_Counters, threadId, RenderCounter::ResolveTime);
+        const TraceScope trace("resolve");
+        std::vector<uint32_t> contendedTiles;
+        uint32_t doneTileCount = 0;
+
+        for (auto begin = pass.nextTile.fetch_add(s_ResolveBlockSize); begin < pass.tileCount; begin = pass.nextTile.fetch_add(s_ResolveBlockSize))
+        {
+            const auto epoch = m_Epoch.load();
+            for (auto tileIdx = begin, end = std::min(begin + s_ResolveBlockSize, pass.tileCount); tileIdx < end; ++tileIdx)
+            {
+                ++doneTileCount;
+                if (m_Framebuffer.tileGeneration(tileIdx, epoch) == pass.resolvedGenerations[tileIdx]) {
+                    continue; // Up to date, no need to claim it
+                }
+                if (!m_Framebuffer.tryClaimTile(tileIdx)) {
+                    contendedTiles.emplace_back(tileIdx); // Copied after the other ones, when its pass is hopefully done
+                    continue;
+                }
+                if (m_Framebuffer.resolveTile(tileIdx, pass.outImage, epoch, pass.resolvedGenerations[tileIdx], pass.format, pass.exposureScale, &pass.aovImages)) {
+                    m_Counters.add(threadId, RenderCounter::ResolvedTiles, 1);
+                }
+                m_Framebuffer.releaseTile(tileIdx);
+            }
+        }
+
+        for (const auto tileIdx : contendedTiles)
+        {
+            {
+                const RenderCounterTimer claimTimer(&m_Counters, threadId, RenderCounter::ClaimWaitTime);
+                while (!m_Framebuffer.tryClaimTile(tileIdx)) {
+                    std::this_thread::yield();
+                }
+            }
+            if (m_Framebuffer.resolveTile(tileIdx, pass.outImage, m_Epoch, pass.resolvedGenerations[tileIdx], pass.format, pass.exposureScale, &pass.aovImages)) {
+                m_Counters.add(threadId, RenderCounter::ResolvedTiles, 1);
+            }
+            m_Framebuffer.releaseTile(tileIdx);
+        }
+
+        if (doneTileCount && pass.doneTileCount.fetch_add(doneTileCount) + doneTileCount == pass.tileCount)
+        {
+            {
+                std::unique_lock<std::mutex> l{ m_ImageMutex };
+                std::swap(m_BackImage, m_ReadyImage);
+                m_bNewImage = true;
+                std::atomic_store(&m_ResolvePass, std::shared_ptr<ResolvePass>()); // Before bake() can request the next one
+            }
+            m_ResolvedCondition.notify_all();
+        }
+    }
+
+    // A pass of an expensive tile split in bands of pixels. The thread owning the tile publishes it so that other render threads help it.
+    struct SplitPass
+    {
+        const Integrator::RenderTileParams params; // Of the whole tile
+        const uint32_t bandCount;
+        std::atomic_uint32_t nextBand{ 0 };
+        std::atomic_uint32_t doneBandCount{ 0 };
+        std::atomic_bool canceled{ false };
+        std::atomic_uint64_t renderTime{ 0 }; // In nanoseconds, summed over bands
+
+        SplitPass(const Integrator::RenderTileParams & params, uint32_t bandCount) : params(params), bandCount(bandCount)
+        {
+        }
+    };
+
+    // Expensive tiles are split in bands, one per thread at most, so that they do not finish long after the others.
+    //
+    // \return The number of bands to render a tile with, 1 if it must not be split
+    uint32_t splitBandCount(size_t tileId, size_t rowCount) const
+    {
+        const auto meanCost = m_TileScheduler.meanCost();
+        if (m_ThreadCount < 2 || meanCost <= 0.f) {
+            return 1;
+        }
+        const auto costRatio = m_TileScheduler.predictedCost(tileId) / meanCost;
+        if (costRatio < s_SplitCostRatio) {
+            return 1;
+        }
+        return uint32_t(std::min({ size_t(costRatio), size_t(m_ThreadCount), rowCount }));
+    }
+
+    // Render bands of a split pass until all of them have been taken
+    void renderBands(SplitPass & pass, size_t threadId)
+    {
+        for (auto band = pass.nextBand++; band < pass.bandCount; band = pass.nextBand++)
+        {
+            const TraceScope trace("split band", "tile", pass.params.tileId);
+            // Bands are ranges of the pixel order of the tile: rows for the row major layout, blocks for the Morton layout
+            const auto tilePixelCount = pixelCount(pass.params);
+            const auto beginPixel = band * tilePixelCount / pass.bandCount;
+            const auto endPixel = (band + 1) * tilePixelCount / pass.bandCount;
+
+            auto params = pass.params;
+            params.threadId = threadId;
+            params.beginPixel = beginPixel;
+            params.endPixel = endPixel;
+            params.outBuffer += beginPixel;
+            for (auto & aovBuffer : params.aovBuffers) {
+                if (aovBuffer) {
+                    aovBuffer += beginPixel;
+                }
+            }
+
+            const auto renderStart = std::chrono::steady_clock::now();
+            if (!m_Integrator->render(params)) {
+                pass.canceled = true;
+            }
+            const auto renderTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - renderStart).count();
+            pass.renderTime += renderTime;
+            m_Counters.add(threadId, RenderCounter::RenderTime, renderTime);
+            m_Counters.add(threadId, RenderCounter::SplitBands, 1);
+            ++pass.doneBandCount;
+        }
+    }
+
+    // Render one sample of a tile, split in bands rendered with the help of other threads if the tile is expensive
+    //
+    // \arg renderTime Time spent to render the sample, summed over threads. In nanoseconds.
+    //
+    // \return false if the tile has been canceled
+    bool renderSample(const Integrator::RenderTileParams & params, uint64_t & renderTime)
+    {
+        std::shared_ptr<SplitPass> splitPass;
+        const auto bandCount = splitBandCount(params.tileId, params.countY);
+        if (bandCount > 1) {
+            splitPass = std::make_shared<SplitPass>(params, bandCount);
+            std::shared_ptr<SplitPass> noSplitPass;
+            if (!std::atomic_compare_exchange_strong(&m_SplitPass, &noSplitPass, splitPass)) {
+                splitPass = nullptr; // Another tile is being split, render this one alone
+            }
+        }
+
+        if (splitPass) {
+            renderBands(*splitPass, params.threadId);
+            // All bands have been taken, wait for the helpers to finish theirs
+            std::atomic_store(&m_SplitPass, std::shared_ptr<SplitPass>());
+            while (splitPass->doneBandCount != bandCount) {
+                std::this_thread::yield();
+            }
+            renderTime = splitPass->renderTime;
+            ++m_SplitTileCount;
+            return !splitPass->canceled;
+        }
+
+        const auto renderStart = std::chrono::steady_clock::now();
+        const auto rendered = m_Integrator->render(params);
+        renderTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - renderStart).count();
+        m_Counters.add(params.threadId, RenderCounter::RenderTime, renderTime);
+        return rendered;
+    }
+
+    // \return The parameters to render a whole tile of a framebuffer, not cancelable
+    static Integrator::RenderTileParams tileRenderParams(Framebuffer & framebuffer, size_t tileId, size_t threadId, float4 * tilePtr)
+    {
+        const auto bounds = framebuffer.tileBounds(tileId);
+
+        Integrator::RenderTileParams params = {};
+        params.threadId = threadId;
+        params.tileId = tileId;
+        params.sampleCount = 1;
+        params.beginX = bounds.beginX;
+        params.beginY = bounds.beginY;
+        params.countX = bounds.countX;
+        params.countY = bounds.countY;
+        params.beginPixel = 0;
+        params.endPixel = bounds.countX * bounds.countY;
+        params.pixelCoords = framebuffer.tilePixelCoords(tileId);
+        params.outBuffer = tilePtr;
+        for (size_t aovIdx = 0; aovIdx < AOVCount; ++aovIdx) {
+            params.aovBuffers[aovIdx] = framebuffer.tileAOVPtr(tileId, AOV(aovIdx));
+        }
+        params.aovStride = framebuffer.tilePixelCount();
+        params.epoch = nullptr;
+        return params;
+    }
+
+    // Wait after consecutive contended claims, so that a thread only finding claimed tiles does not steal cycles from the threads rendering them
+    static void backOff(size_t contendedClaimCount)
+    {
+        if (contendedClaimCount <= s_SpinClaimCount) {
+            return;
+        }
+        if (contendedClaimCount <= 2 * s_SpinClaimCount) {
+            std::this_thread::yield();
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(size_t(1) << std::min(contendedClaimCount - 2 * s_SpinClaimCount, size_t(s_MaxBackOffShift))));
+    }
+
     void renderTask(size_t threadId)
     {
+        std::vector<float> tileLuminance; // Luminance of the current tile before its pass, to isolate the samples of the pass
+        std::vector<float4> tileScratch; // Decoded pixels of the current tile, for compact tile storages
+        size_t contendedClaimCount = 0; // Since the last tile claimed by this thread
+
         while (!m_bStopped)
         {
             if (m_bPaused && !m_bStopped) {
-                ++m_PausedThreadCount;
-                std::unique_lock<std::mutex> l{ m_UnpauseMutex };
-                m_UnpauseCondition.wait(l, [this]() { return !(m_bPaused && !m_bStopped); });
+                std::unique_lock<std::mutex> l{ m_PauseMutex };
+                if (m_bPaused && !m_bStopped) {
+                    // The last thread to arrive wakes up the thread waiting in pause()
+                    if (++m_PausedThreadCount == m_ThreadCount) {
+                        m_PausedCondition.notify_one();
+                    }
+                    // Wait for this pause to end, even if pause() is called again before this thread wakes up
+                    const auto resumeCount = m_ResumeCount;
+                    const RenderCounterTimer timer(&m_Counters, threadId, RenderCounter::PausedTime);
+                    m_UnpauseCondition.wait(l, [this, resumeCount]() { return m_ResumeCount != resumeCount || m_bStopped; });
+                }
             }
 
             if (m_bStopped) {
                 break;
             }
-            const auto tileId = m_TilePermutation[m_NextTile++ % m_Framebuffer.tileCount()];
-            const auto l = m_Framebuffer.lockTile(tileId);
 
+            // Resolve requests come first: until the pass is done, bake() keeps publishing the previous image, or waits for it with a frame budget
+            if (const auto resolvePass = std::atomic_load(&m_ResolvePass)) {
+                resolveTiles(*resolvePass, threadId);
+            }
+
+            // Help the owner of a split tile before taking a new tile
+            if (const auto splitPass = std::atomic_load(&m_SplitPass)) {
+                renderBands(*splitPass, threadId);
+            }
+
+            const auto epoch = m_Epoch.load();
+            const auto frameIndex = m_FrameIndex.load();
+            const auto tileId = m_TileScheduler.nextTile(epoch);
             const auto bounds = m_Framebuffer.tileBounds(tileId);
-            float4 * tilePtr = m_Framebuffer.tileDataPtr(tileId);
 
-            Integrator::RenderTileParams params = {};
-            params.threadId = threadId;
-            params.tileId = tileId;
-            params.startSample = m_TileSampleCount[tileId];
-            params.sampleCount = 1;
-            params.beginX = bounds.beginX;
-            params.beginY = bounds.beginY;
-            params.countX = bounds.countX;
-            params.countY = bounds.countY;
-            params.outBuffer = tilePtr;
-
-            m_Integrator->render(params);
-            ++m_TileSampleCount[tileId];
+            const auto sampleCount = passSampleCount(tileId, bounds.countY);
+            if (!sampleCount) {
+                // Not even one sample of this tile fits in the frame budget
+                const RenderCounterTimer timer(&m_Counters, threadId, RenderCounter::FrameWaitTime);
+                waitNextFrame(frameIndex);
+                continue;
+            }
+
+            if (!m_Framebuffer.tryClaimTile(tileId)) {
+                // Another thread renders another pass of this tile: take the next one instead of waiting
+                ++m_ContendedTileCount;
+                m_Counters.add(threadId, RenderCounter::ContendedTiles, 1);
+                const RenderCounterTimer timer(&m_Counters, threadId, RenderCounter::ClaimWaitTime);
+                backOff(++contendedClaimCount);
+                continue;
+            }
+            contendedClaimCount = 0;
+            const auto release = finally([&]() { m_Framebuffer.releaseTile(tileId); });
+            const TraceScope trace("tile", "tile", tileId);
+
+            if (m_Framebuffer.acquireTile(tileId, epoch)) {
+                m_TileSampleCount[tileId] = 0;
+            }
+
+            tileLuminance.resize(m_Framebuffer.tilePixelCount());
+            if (!TileStorage::IsDirect) {
+                tileScratch.resize(m_Framebuffer.tilePixelCount());
+            }
+
+            float4 * tilePtr = m_Framebuffer.loadTile(tileId, tileScratch.data());
+
+            auto params = tileRenderParams(m_Framebuffer, tileId, threadId, tilePtr);
+            params.epoch = &m_Epoch;
+            params.tileEpoch = epoch;
+            params.counters = &m_Counters;
+
+            // Samples of a pass are rendered one by one to isolate them in the variance estimate
+            for (size_t sampleIdx = 0; sampleIdx < sampleCount; ++sampleIdx)
+            {
+                params.startSample = m_TileSampleCount[tileId];
+                m_Framebuffer.storeTileLuminance(tilePtr, tileLuminance.data());
+
+                uint64_t renderTime; // In nanoseconds, summed over threads
+                if (!renderSample(params, renderTime)) {
+                    ++m_CanceledTileCount;
+                    m_Counters.add(threadId, RenderCounter::CanceledPasses, 1);
+                    break;
+                }
+
+                m_TunedRenderTime += renderTime;
+                m_TunedSampleCount += pixelCount(params) * params.sampleCount;
+                m_FrameRenderTime += renderTime;
+                ++m_FrameRenderedSampleCount;
+
+                m_Framebuffer.accumulateLuminanceSquares(tileId, tilePtr, tileLuminance.data());
+                m_Framebuffer.commitTile(tileId);
+                ++m_TileSampleCount[tileId];
+                m_TileScheduler.reportTile(tileId, epoch, m_TileSampleCount[tileId], m_Framebuffer.estimateTileError(tileId, tilePtr), float(renderTime));
+
+                ++m_TotalRenderedTileCount;
+                m_Counters.add(threadId, RenderCounter::TilePasses, 1);
+                if (epoch == m_Epoch) {
+                    ++m_RenderedTileCount;
+                }
+
+                if (m_bStopped || m_bPaused) {
+                    break;
+                }
+            }
+
+            m_Framebuffer.storeTile(tileId, tilePtr);
 
             if (m_bStopped) {
                 break;
@@ -196,28 +1314,95 @@ private:
         }
     }
 
-    bool m_bPaused = false;
-    bool m_bStopped = true;
+    std::atomic_bool m_bPaused{ false };
+    std::atomic_bool m_bStopped{ true };
     bool m_Dirty = true;
 
-    static const size_t s_TileSize = 16;
-    TiledFramebuffer m_Framebuffer;
+    size_t m_TileSize = 0;
+    size_t m_FixedTileSize = 0;
+    size_t m_CheckpointTileSize = 0; // Overrides m_FixedTileSize while a checkpoint is set
+    TilePixelLayout m_TilePixelLayout = TilePixelLayout::RowMajor;
+    AOVSet m_AOVs = 0;
+    TileSizeAutotuner m_TileSizeAutotuner;
+    Framebuffer m_Framebuffer;
 
-    std::vector<size_t> m_TilePermutation;
+    TileScheduler m_TileScheduler;
     std::vector<size_t> m_TileSampleCount;
 
-    std::vector<float4> m_Image;
+    bool m_bDeterministic = false;
+    uint32_t m_nSeed = 0;
+
+    // Checkpoint storing the framebuffer, see setCheckpoint()
+    std::string m_CheckpointPath;
+    RenderCheckpoint m_Checkpoint;
+    std::vector<size_t> m_ResumedTiles; // Tiles of the checkpoint restored by the next clear
+
+    // Triple buffered image: displayed, last resolved, being resolved. Indices are swapped with m_ImageMutex locked.
+    std::vector<uint8_t> m_Images[3]; // Empty when the images are shared
+    uint8_t * m_ImageData[3] = {}; // Pixels of each image, in m_Images or in the shared image
+    std::array<std::vector<float>, AOVCount> m_AOVImages[3]; // Of each image, empty for disabled AOVs
+    std::vector<uint32_t> m_ImageGenerations[3]; // Generation of each tile in each image, see BasicTiledFramebuffer::resolveTile()
+    size_t m_FrontImage = 0;
+    size_t m_ReadyImage = 1;
+    size_t m_BackImage = 2;
+    bool m_bNewImage = false; // The ready image has not been displayed yet
+    PixelFormat m_PixelFormat = PixelFormat::RGBA32F;
+    float m_Exposure = 0.f;
+    bool m_bImagesDirty = false; // Images must be reset for a new pixel format or exposure
+    std::string m_SharedImageName; // See setSharedImage()
+    SharedMemory m_SharedImage;
+    std::mutex m_ImageMutex;
+    std::condition_variable m_ResolvedCondition; // Notified when a resolve pass is done
+    std::shared_ptr<ResolvePass> m_ResolvePass; // Pass open to render threads, accessed with atomic operations
+
+    static constexpr uint32_t s_ResolveBlockSize = 16; // Tiles taken at once by a thread resolving the image
 
-    std::atomic_uint32_t m_NextTile{ 0 };
     std::future<void> m_RenderTaskFuture;
 
+    uint32_t m_RequestedThreadCount{ 0 };
     uint32_t m_ThreadCount{ 0 };
-    std::atomic_uint32_t m_PausedThreadCount{ 0 };
+    std::atomic_uint32_t m_RenderedTileCount{ 0 };
+    std::atomic_uint32_t m_Epoch{ 0 };
+
+    std::atomic_uint64_t m_TotalRenderedTileCount{ 0 };
+    std::atomic_uint64_t m_CanceledTileCount{ 0 };
+    std::atomic_uint64_t m_ContendedTileCount{ 0 };
+    std::atomic_uint64_t m_SplitTileCount{ 0 };
+    RenderCounters m_Counters; // Per thread, see counters()
+
+    std::shared_ptr<SplitPass> m_SplitPass; // Pass open to helpers, accessed with atomic operations
 
-    std::mutex m_UnpauseMutex;
-    std::condition_variable m_UnpauseCondition;
+    static constexpr float s_SplitCostRatio = 4.f; // Tiles costing more than this times the mean cost are split
+
+    static constexpr size_t s_SpinClaimCount = 4; // Contended claims retried at once, then as many after a yield, then after growing sleeps
+    static constexpr size_t s_MaxBackOffShift = 10; // Sleeps last at most 2^10 microseconds
+
+    // Frame budget, see setFrameBudget(). Times are in nanoseconds, deadlines are steady clock times.
+    std::atomic<int64_t> m_FrameBudget{ 0 };
+    std::atomic<int64_t> m_FrameDeadline{ 0 };
+    std::atomic_uint32_t m_FrameIndex{ 0 };
+    std::atomic_size_t m_FrameSampleCount{ 1 }; // Maximal number of samples of a tile pass
+    std::atomic_uint64_t m_FrameRenderTime{ 0 }; // Summed over threads
+    std::atomic_uint64_t m_FrameRenderedSampleCount{ 0 };
+    int64_t m_FrameStart = 0; // Protected by m_PauseMutex
+    FrameStats m_LastFrameStats = {}; // Protected by m_PauseMutex
+
+    static constexpr uint32_t s_MaxPassSampleCount = 64;
+
+    // Throughput of the current tile size, reset when tiles are reset
+    std::atomic_uint64_t m_TunedSampleCount{ 0 };
+    std::atomic_uint64_t m_TunedRenderTime{ 0 }; // In nanoseconds, summed over threads
+
+    uint32_t m_PausedThreadCount{ 0 }; // Protected by m_PauseMutex
+    uint32_t m_ResumeCount{ 0 }; // Protected by m_PauseMutex
+    mutable std::mutex m_PauseMutex;
+    std::condition_variable m_PausedCondition; // Notified when all threads are paused
+    std::condition_variable m_UnpauseCondition; // Notified when threads must resume or stop
+    std::condition_variable m_NextFrameCondition; // Notified when a frame starts, or when threads waiting for it must pause or stop
 
     std::unique_ptr<Integrator> m_Integrator = std::make_unique<AOIntegrator>();
 };
 
+using TileRenderer = BasicTileRenderer<>;
+
 }
\ No newline at end of file
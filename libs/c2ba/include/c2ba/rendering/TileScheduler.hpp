@@ -0,0 +1,241 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+namespace c2ba
+{
+
+// Hand out tiles to render threads in rounds, noisy tiles being given more passes per round than converged ones.
+// Each round is a list of tiles built from the errors reported for the previous passes: tiles with too few samples
+// to estimate their error get one pass, tiles above the target error get a number of passes proportional to their error,
+// and converged tiles get none until the whole image has converged, except the least converged ones filling rounds that would
+// have fewer tiles than render threads.
+// The passes of a round are ordered by decreasing cost of the previous pass of their tile, so that the last tiles of a round
+// are cheap ones and threads finish at about the same time.
+class TileScheduler
+{
+public:
+    // Start over with new tiles. Must not be called while threads call nextTile().
+    void reset(size_t tileCount)
+    {
+        m_Tiles = std::vector<TileState>(tileCount);
+        std::atomic_store(&m_Round, std::shared_ptr<Round>());
+        m_ConvergedTileCount = 0;
+        m_MeanCost = 0.f;
+    }
+
+    // Seed the shuffle of the tiles of equal cost, seeded by std::random_device by default. Must not be called while threads call nextTile().
+    void seed(uint32_t value)
+    {
+        std::unique_lock<std::mutex> l{ m_RoundMutex };
+        m_RandomGenerator.seed(value);
+    }
+
+    // Tiles whose estimated error is lower or equal to the target get no more passes. 0 means refining all noisy tiles forever.
+    void setTargetError(float error)
+    {
+        m_TargetError = error;
+    }
+
+    float targetError() const
+    {
+        return m_TargetError;
+    }
+
+    // Rounds contain at least this many distinct tiles, 1 by default: once only a few tiles are noisy, the threads would otherwise
+    // find them all claimed and rebuild rounds in a loop. Must not be called while threads call nextTile().
+    void setThreadCount(size_t count)
+    {
+        m_ThreadCount = std::max(count, size_t(1));
+    }
+
+    // \return The number of tiles that had reached the target error when the current round was built
+    size_t convergedTileCount() const
+    {
+        return m_ConvergedTileCount;
+    }
+
+    // \return true if all tiles had reached the target error when the current round was built, in which case tiles are refined uniformly
+    bool isConverged() const
+    {
+        return !m_Tiles.empty() && m_ConvergedTileCount == m_Tiles.size();
+    }
+
+    // \return The cost of the last pass of a tile, or the mean cost if the tile has never been rendered. In nanoseconds.
+    float predictedCost(size_t tileIdx) const
+    {
+        const auto cost = m_Tiles[tileIdx].cost.load(std::memory_order_relaxed);
+        return cost > 0.f ? cost : m_MeanCost.load();
+    }
+
+    // \return The mean cost of a tile pass when the current round was built, 0 if no tile has been rendered yet. In nanoseconds.
+    float meanCost() const
+    {
+        return m_MeanCost;
+    }
+
+    // Thread safe. A new round is started when the current one is exhausted or has been built for another epoch.
+    //
+    // \return The index of the next tile to render
+    size_t nextTile(uint32_t epoch)
+    {
+        while (true)
+        {
+            auto round = std::atomic_load(&m_Round);
+            if (round && round->epoch == epoch) {
+                const auto idx = round->next++;
+                if (idx < round->tiles.size()) {
+                    return round->tiles[idx];
+                }
+            }
+
+            std::unique_lock<std::mutex> l{ m_RoundMutex };
+            if (std::atomic_load(&m_Round) == round) { // Another thread might have started the new round while we were waiting
+                std::atomic_store(&m_Round, buildRound(epoch));
+            }
+        }
+    }
+
+    // Report the state of a tile after a pass. Must be called by the thread owning the tile.
+    //
+    // \arg sampleCount Number of passes accumulated in the tile since it has been cleared
+    // \arg error Estimated error of the tile, negative if unknown
+    // \arg cost Time spent to render the pass, summed over the threads that rendered it. In nanoseconds.
+    void reportTile(size_t tileIdx, uint32_t epoch, size_t sampleCount, float error, float cost)
+    {
+        auto & tile = m_Tiles[tileIdx];
+        tile.sampleCount.store(uint32_t(sampleCount), std::memory_order_relaxed);
+        tile.error.store(error, std::memory_order_relaxed);
+        tile.cost.store(cost, std::memory_order_relaxed);
+        tile.epoch.store(epoch, std::memory_order_release);
+    }
+
+private:
+    struct TileState
+    {
+        std::atomic_uint32_t epoch{ 0 };
+        std::atomic_uint32_t sampleCount{ 0 }; // Of the epoch
+        std::atomic<float> error{ -1.f };
+        std::atomic<float> cost{ 0.f }; // Of the last pass, whatever its epoch: a small camera move barely changes the cost of a tile
+    };
+
+    struct Round
+    {
+        uint32_t epoch;
+        std::vector<uint32_t> tiles;
+        std::atomic_size_t next{ 0 };
+    };
+
+    // Must be called with m_RoundMutex locked
+    std::shared_ptr<Round> buildRound(uint32_t epoch)
+    {
+        auto round = std::make_shared<Round>();
+        round->epoch = epoch;
+
+        std::vector<size_t> passCounts(m_Tiles.size(), 0);
+        std::vector<float> costs(m_Tiles.size()); // Snapshot, render threads keep updating the tiles while the round is sorted
+        std::vector<std::pair<uint32_t, float>> noisyTiles;
+        std::vector<std::pair<uint32_t, float>> convergedTiles;
+        double noisyErrorSum = 0.;
+        double costSum = 0.;
+        size_t costCount = 0;
+        size_t convergedTileCount = 0;
+        for (size_t tileIdx = 0; tileIdx < m_Tiles.size(); ++tileIdx)
+        {
+            const auto & tile = m_Tiles[tileIdx];
+            const auto isFresh = tile.epoch.load(std::memory_order_acquire) == epoch;
+            const auto error = tile.error.load(std::memory_order_relaxed);
+            if (!isFresh || tile.sampleCount.load(std::memory_order_relaxed) < s_MinSampleCount || error < 0.f) {
+                passCounts[tileIdx] = 1;
+            }
+            else if (error > m_TargetError) {
+                noisyTiles.emplace_back(uint32_t(tileIdx), error);
+                noisyErrorSum += error;
+            }
+            else {
+                convergedTiles.emplace_back(uint32_t(tileIdx), error);
+                ++convergedTileCount;
+            }
+
+            costs[tileIdx] = tile.cost.load(std::memory_order_relaxed);
+            if (costs[tileIdx] > 0.f) {
+                costSum += costs[tileIdx];
+                ++costCount;
+            }
+        }
+
+        const auto meanCost = costCount ? float(costSum / costCount) : 0.f;
+        for (auto & cost : costs) {
+            if (cost <= 0.f) {
+                cost = meanCost;
+            }
+        }
+        m_MeanCost = meanCost;
+
+        // The mean error gets one pass, noisier tiles get more
+        const auto meanError = noisyTiles.empty() ? 0. : noisyErrorSum / noisyTiles.size();
+        for (const auto & tile : noisyTiles) {
+            passCounts[tile.first] = std::min(size_t(s_MaxPassCount), std::max(size_t(1), size_t(std::ceil(tile.second / meanError))));
+        }
+
+        if (convergedTileCount == m_Tiles.size()) {
+            // The target is reached everywhere: keep refining uniformly rather than leaving the render threads without work
+            std::fill(begin(passCounts), end(passCounts), 1);
+        }
+        else {
+            // Refine the converged tiles of highest error too, so that each thread gets a tile of its own
+            const auto roundTileCount = size_t(std::count_if(begin(passCounts), end(passCounts), [](size_t passCount) { return passCount > 0; }));
+            if (roundTileCount < m_ThreadCount) {
+                const auto fillCount = std::min(m_ThreadCount - roundTileCount, convergedTiles.size());
+                std::partial_sort(begin(convergedTiles), begin(convergedTiles) + fillCount, end(convergedTiles),
+                    [](const std::pair<uint32_t, float> & lhs, const std::pair<uint32_t, float> & rhs) { return lhs.second > rhs.second; });
+                for (size_t i = 0; i < fillCount; ++i) {
+                    passCounts[convergedTiles[i].first] = 1;
+                }
+            }
+        }
+
+        // The round is made of waves, the n-th wave containing the tiles having more than n passes.
+        // Passes of a same tile are spread over the waves, otherwise threads would contend for it.
+        // Each wave is sorted by decreasing cost, after a shuffle so that tiles of equal or unknown cost are not rendered in scanline order.
+        for (size_t wave = 0; wave < s_MaxPassCount; ++wave)
+        {
+            const auto waveBegin = round->tiles.size();
+            for (size_t tileIdx = 0; tileIdx < m_Tiles.size(); ++tileIdx) {
+                if (passCounts[tileIdx] > wave) {
+                    round->tiles.emplace_back(uint32_t(tileIdx));
+                }
+            }
+            const auto waveStart = begin(round->tiles) + waveBegin;
+            std::shuffle(waveStart, end(round->tiles), m_RandomGenerator);
+            std::stable_sort(waveStart, end(round->tiles), [&](uint32_t lhs, uint32_t rhs)
+            {
+                return costs[lhs] > costs[rhs];
+            });
+        }
+
+        m_ConvergedTileCount = convergedTileCount;
+        return round;
+    }
+
+    static const uint32_t s_MinSampleCount = 4; // Below, the error estimate of a tile is not trusted
+    static const size_t s_MaxPassCount = 4; // Maximal number of passes of a tile in a round
+
+    std::vector<TileState> m_Tiles;
+    std::atomic<float> m_TargetError{ 0.f };
+    size_t m_ThreadCount = 1;
+    std::atomic_size_t m_ConvergedTileCount{ 0 };
+    std::atomic<float> m_MeanCost{ 0.f };
+
+    std::shared_ptr<Round> m_Round;
+    std::mutex m_RoundMutex;
+    std::mt19937 m_RandomGenerator{ std::random_device{}() }; // Protected by m_RoundMutex
+};
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+namespace c2ba
+{
+
+// Find the tile size giving the best throughput by trying candidate sizes one after the other on the real workload.
+// The best size depends on the integrator, the ray API, the number of threads and the cache sizes, so it cannot be chosen statically.
+class TileSizeAutotuner
+{
+public:
+    struct Result
+    {
+        size_t tileSize;
+        double samplesPerSecond; // Pixel samples per second and per thread
+    };
+
+    // Start a new tuning session. Candidates are tried in order, the first one is also the size used if no measure is ever reported.
+    void restart(std::vector<size_t> candidates = { 8, 16, 32, 64 })
+    {
+        m_Candidates = std::move(candidates);
+        m_Results.clear();
+        m_nCurrent = 0;
+    }
+
+    bool isTuning() const
+    {
+        return m_nCurrent < m_Candidates.size();
+    }
+
+    // \return The tile size to render with
+    size_t tileSize() const
+    {
+        if (isTuning()) {
+            return m_Candidates[m_nCurrent];
+        }
+        return m_Results.empty() ? s_DefaultTileSize : bestResult().tileSize;
+    }
+
+    // Report the throughput measured with the current tile size.
+    //
+    // \arg sampleCount Number of pixel samples completed since the last measure
+    // \arg renderSeconds Time spent by render threads to complete them, summed over threads
+    //
+    // \return true if the tile size to render with has changed
+    bool addMeasure(uint64_t sampleCount, double renderSeconds)
+    {
+        if (!isTuning()) {
+            return false;
+        }
+
+        const auto previousTileSize = tileSize();
+        m_Results.push_back({ previousTileSize, renderSeconds > 0. ? sampleCount / renderSeconds : 0. });
+        ++m_nCurrent;
+
+        return tileSize() != previousTileSize;
+    }
+
+    const std::vector<Result> & results() const
+    {
+        return m_Results;
+    }
+
+private:
+    const Result & bestResult() const
+    {
+        return *std::max_element(begin(m_Results), end(m_Results), [](const Result & lhs, const Result & rhs)
+        {
+            return lhs.samplesPerSecond < rhs.samplesPerSecond;
+        });
+    }
+
+    static const size_t s_DefaultTileSize = 16;
+
+    std::vector<size_t> m_Candidates;
+    std::vector<Result> m_Results;
+    size_t m_nCurrent = 0;
+};
+
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "../maths.hpp"
+
+namespace c2ba
+{
+
+// Storage policies of the accumulated pixels of a TiledFramebuffer.
+//
+// Direct storages keep float4 pixels (sum of the samples in rgb, sample count in w) that integrators accumulate in place.
+// Compact storages keep the mean of the samples of each pixel in an encoded texel, and one sample count per tile:
+// a tile is decoded to float4 pixels before a pass and encoded back after it. They assume that all the pixels of a tile get the same
+// number of samples, as the variance estimate of the framebuffer already does.
+//
+// The mean is re-quantized after each pass, so compact storages trade convergence for memory: a pass moves the mean of a pixel
+// by (sample - mean) / (N + 1), which rounds to nothing once it falls below half a quantization step of the mean: after 2^11 to
+// 2^12 times |sample - mean| / mean samples for half floats, 2^9 to 2^10 times |sample - mean| / maxComponent for RGB9E5.
+// Beyond that, the image stops refining and rounding errors of the remaining passes bias it. They suit previews and low sample
+// counts; accumulate long renders with Float4TileStorage.
+//
+// A storage defines:
+// - Texel: the stored type of a pixel
+// - IsDirect: true if Texel is float4 and integrators can write to it
+// - zero(): the texel of a pixel without samples, all its bytes must be zeros so that zeroed memory is an empty framebuffer
+// - encode(float3 mean) / decode(Texel) for compact storages
+
+struct Float4TileStorage
+{
+    using Texel = float4;
+    static constexpr bool IsDirect = true;
+
+    static Texel zero()
+    {
+        return float4(0.f);
+    }
+};
+
+// IEEE 754 binary16, round to nearest even
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    const auto sign = (bits >> 16) & 0x8000u;
+    const auto exponent = int32_t((bits >> 23) & 0xFF) - 127 + 15;
+    auto mantissa = bits & 0x7FFFFFu;
+
+    if (((bits >> 23) & 0xFF) == 0xFF) { // Inf or NaN
+        return uint16_t(sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+    }
+    if (exponent >= 31) { // Overflow
+        return uint16_t(sign | 0x7C00u);
+    }
+    if (exponent <= 0) { // Denormal or zero
+        if (exponent < -10) {
+            return uint16_t(sign);
+        }
+        mantissa |= 0x800000u;
+        const auto shift = uint32_t(14 - exponent);
+        auto halfMantissa = mantissa >> shift;
+        const auto remainder = mantissa & ((1u << shift) - 1u);
+        const auto halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (halfMantissa & 1u))) {
+            ++halfMantissa;
+        }
+        return uint16_t(sign | halfMantissa);
+    }
+
+    auto half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+    const auto remainder = mantissa & 0x1FFFu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+        ++half; // May carry into the exponent, which correctly rounds up to the next power of two or to infinity
+    }
+    return uint16_t(half);
+}
+
+inline float halfToFloat(uint16_t half)
+{
+    const auto sign = uint32_t(half & 0x8000u) << 16;
+    auto exponent = uint32_t(half >> 10) & 0x1Fu;
+    auto mantissa = uint32_t(half) & 0x3FFu;
+
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    }
+    else if (exponent == 0) {
+        if (!mantissa) {
+            bits = sign;
+        }
+        else { // Denormal: normalize it
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400u)) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+        }
+    }
+    else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// 6 bytes per pixel: the mean of the samples as three half floats
+struct HalfTileStorage
+{
+    struct Texel
+    {
+        uint16_t r, g, b;
+    };
+    static constexpr bool IsDirect = false;
+
+    static Texel zero()
+    {
+        return{ 0, 0, 0 };
+    }
+
+    static Texel encode(const float3 & mean)
+    {
+        return{ floatToHalf(mean.x), floatToHalf(mean.y), floatToHalf(mean.z) };
+    }
+
+    static float3 decode(const Texel & texel)
+    {
+        return float3(halfToFloat(texel.r), halfToFloat(texel.g), halfToFloat(texel.b));
+    }
+};
+
+// 4 bytes per pixel: the mean of the samples with 9 bits mantissas and a shared 5 bits exponent (GL_RGB9_E5 layout).
+// Negative values are clamped to 0.
+struct RGB9E5TileStorage
+{
+    using Texel = uint32_t;
+    static constexpr bool IsDirect = false;
+
+    static Texel zero()
+    {
+        return 0;
+    }
+
+    static Texel encode(const float3 & mean)
+    {
+        const auto maxValue = float(0x1FF) / 0x200 * std::exp2(float(s_MaxExponent - s_ExponentBias));
+        const auto r = std::min(std::max(mean.x, 0.f), maxValue);
+        const auto g = std::min(std::max(mean.y, 0.f), maxValue);
+        const auto b = std::min(std::max(mean.z, 0.f), maxValue);
+        const auto maxComponent = std::max({ r, g, b });
+        if (maxComponent <= 0.f) {
+            return 0;
+        }
+
+        auto exponent = std::max(-s_ExponentBias - 1, int32_t(std::floor(std::log2(maxComponent)))) + 1 + s_ExponentBias;
+        auto scale = std::exp2(float(s_MantissaBits + s_ExponentBias - exponent));
+        if (uint32_t(maxComponent * scale + 0.5f) == (1u << s_MantissaBits)) {
+            ++exponent;
+            scale *= 0.5f;
+        }
+
+        return uint32_t(r * scale + 0.5f) | (uint32_t(g * scale + 0.5f) << 9) | (uint32_t(b * scale + 0.5f) << 18) | (uint32_t(exponent) << 27);
+    }
+
+    static float3 decode(const Texel & texel)
+    {
+        const auto scale = std::exp2(float(int32_t(texel >> 27) - s_ExponentBias - s_MantissaBits));
+        return float3(float(texel & 0x1FF), float((texel >> 9) & 0x1FF), float((texel >> 18) & 0x1FF)) * scale;
+    }
+
+private:
+    static const int32_t s_MantissaBits = 9;
+    static const int32_t s_ExponentBias = 15;
+    static const int32_t s_MaxExponent = 31;
+};
+
+}
@@ -1,17 +1,39 @@
 #pragma once
 
 #include <vector>
-#include <mutex>
+#include <atomic>
 #include <algorithm>
+#include <cmath>
+#include <cassert>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+#include <memory>
+#include <new>
 
 #include "../maths.hpp"
+#include "../threads.hpp"
+#include "PixelFormat.hpp"
+#include "TileStorage.hpp"
+#include "TilePixelLayout.hpp"
+#include "AOV.hpp"
 
 namespace c2ba
 {
 
-class TiledFramebuffer
+// An image split in square tiles, each tile being stored contiguously. Pixels of a tile are in row major order with a row stride equal
+// to the width of the tile in the image, or in Morton order, see TilePixelLayout.
+// Enabled AOVs are stored next to the accumulated pixels as structures of arrays: each tile stores each component of each AOV contiguously.
+// The accumulated pixels, AOVs, second moments and tile epochs can be stored in memory provided by the caller, e.g. a mapped file,
+// so that a render can be resumed from them.
+//
+// \tparam Storage How the accumulated pixels are stored, see TileStorage.hpp
+template<typename Storage = Float4TileStorage>
+class BasicTiledFramebuffer
 {
 public:
+    using Texel = typename Storage::Texel;
+
     struct TileBounds
     {
         size_t beginX;
@@ -20,31 +42,231 @@ public:
         size_t countY;
     };
 
-    TiledFramebuffer() = default;
+    BasicTiledFramebuffer() = default;
 
-    TiledFramebuffer(size_t tileSize, size_t imageWidth, size_t imageHeight) :
+    // \arg persistentMemory persistentByteSize() bytes storing the accumulated pixels, AOVs, second moments and tile epochs.
+    // Its content is kept, zeros being an empty framebuffer. Must outlive the framebuffer. nullptr to allocate it.
+    BasicTiledFramebuffer(size_t tileSize, size_t imageWidth, size_t imageHeight, TilePixelLayout pixelLayout = TilePixelLayout::RowMajor, AOVSet aovs = 0,
+        void * persistentMemory = nullptr) :
+        m_PixelLayout{ pixelLayout }, m_AOVs{ aovs }, m_nAOVComponentCount{ aovComponentCount(aovs) },
         m_nTileSize{ tileSize }, m_nTilePixelCount{ m_nTileSize * m_nTileSize },
         m_nImageWidth{ imageWidth }, m_nImageHeight{ imageHeight }, m_nPixelCount{ m_nImageWidth * m_nImageHeight },
         m_nTileCountX{ (m_nImageWidth / m_nTileSize) + ((m_nImageWidth % m_nTileSize) ? 1 : 0) }, m_nTileCountY{ (m_nImageHeight / m_nTileSize) + ((m_nImageHeight % m_nTileSize) ? 1 : 0) },
         m_nTileCount{ m_nTileCountX * m_nTileCountY },
-        m_Data(m_nTileCount * m_nTilePixelCount, float4(0.f)),
-        m_TileLocks{ m_nTileCount }
+        m_TileClaims(m_nTileCount),
+        m_TileGenerations(m_nTileCount)
+    {
+        size_t aovOffset = 0;
+        for (size_t aovIdx = 0; aovIdx < AOVCount; ++aovIdx) {
+            m_AOVOffsets[aovIdx] = aovOffset;
+            if (hasAOV(m_AOVs, AOV(aovIdx))) {
+                aovOffset += aovComponentCount(AOV(aovIdx));
+            }
+        }
+
+        const auto layout = persistentLayout(m_nTileCount, m_nTilePixelCount, m_nAOVComponentCount);
+        auto memory = (char *)persistentMemory;
+        if (!memory) {
+            m_OwnedMemory.reset(new char[layout.byteSize]()); // Zeros
+            memory = m_OwnedMemory.get();
+        }
+        m_Data = (Texel *)(memory + layout.data);
+        m_TileSampleCounts = Storage::IsDirect ? nullptr : (float *)(memory + layout.tileSampleCounts);
+        m_LuminanceSquares = (float *)(memory + layout.luminanceSquares);
+        m_AOVData = (float *)(memory + layout.aovData);
+        m_TileEpochs = (std::atomic_uint32_t *)(memory + layout.tileEpochs);
+        static_assert(sizeof(std::atomic_uint32_t) == sizeof(uint32_t), "Tile epochs are stored as integers in persistent memory");
+        for (size_t tileIdx = 0; tileIdx < m_nTileCount; ++tileIdx) {
+            const auto epoch = ((const uint32_t *)m_TileEpochs)[tileIdx];
+            new (&m_TileEpochs[tileIdx]) std::atomic_uint32_t(epoch);
+        }
+
+        if (m_PixelLayout == TilePixelLayout::Morton) {
+            // Right and bottom tiles may be partial, so that there are up to 4 tile sizes
+            for (size_t orderIdx = 0; orderIdx < 4; ++orderIdx) {
+                const auto countX = (orderIdx & 1) && (m_nImageWidth % m_nTileSize) ? m_nImageWidth % m_nTileSize : m_nTileSize;
+                const auto countY = (orderIdx & 2) && (m_nImageHeight % m_nTileSize) ? m_nImageHeight % m_nTileSize : m_nTileSize;
+                m_PixelOrders[orderIdx] = TilePixelOrder(countX, countY);
+            }
+        }
+    }
+
+    // \return The size of the persistent memory of a framebuffer, see the constructor
+    static size_t persistentByteSize(size_t tileSize, size_t imageWidth, size_t imageHeight, AOVSet aovs = 0)
+    {
+        const auto tileCount = ((imageWidth + tileSize - 1) / tileSize) * ((imageHeight + tileSize - 1) / tileSize);
+        return persistentLayout(tileCount, tileSize * tileSize, aovComponentCount(aovs)).byteSize;
+    }
+
+    // Generation of a tile as seen by a consumer of resolveTile(), never returned by tileGeneration()
+    static constexpr uint32_t EmptyGeneration = std::numeric_limits<uint32_t>::max();
+
+    // Try to take the exclusive ownership of a tile. Never blocks.
+    //
+    // \return false if another thread owns the tile
+    bool tryClaimTile(size_t tileIdx)
+    {
+        return !m_TileClaims[tileIdx].exchange(true, std::memory_order_acquire);
+    }
+
+    void releaseTile(size_t tileIdx)
+    {
+        m_TileClaims[tileIdx].store(false, std::memory_order_release);
+    }
+
+    // Tiles are stamped with the epoch of the renderer that produced their content, a tile with an older epoch is considered empty.
+    // Must be called with the tile claimed, before writing to it.
+    //
+    // \return true if the tile was stale and has been cleared
+    bool acquireTile(size_t tileIdx, uint32_t epoch)
+    {
+        if (m_TileEpochs[tileIdx] == epoch) {
+            return false;
+        }
+        commitTile(tileIdx);
+
+        const auto tileData = tileDataPtr(tileIdx);
+        std::fill(tileData, tileData + m_nTilePixelCount, Storage::zero());
+        if (!Storage::IsDirect) {
+            m_TileSampleCounts[tileIdx] = 0.f;
+        }
+        const auto squares = m_LuminanceSquares + tileIdx * m_nTilePixelCount;
+        std::fill(squares, squares + m_nTilePixelCount, 0.f);
+        const auto aovData = m_AOVData + tileIdx * m_nTilePixelCount * m_nAOVComponentCount;
+        std::fill(aovData, aovData + m_nTilePixelCount * m_nAOVComponentCount, 0.f);
+        m_TileEpochs[tileIdx] = epoch;
+        return true;
+    }
+
+    uint32_t tileEpoch(size_t tileIdx) const
+    {
+        return m_TileEpochs[tileIdx];
+    }
+
+    // Stamp a tile with an epoch without clearing it, to resume the rendering of a tile found in persistent memory.
+    // Must be called with the tile claimed.
+    void restoreTile(size_t tileIdx, uint32_t epoch)
+    {
+        m_TileEpochs[tileIdx] = epoch;
+        commitTile(tileIdx);
+    }
+
+    // \return The number of samples accumulated in the pixels of a tile, whatever its epoch. Must be called with the tile claimed.
+    size_t storedSampleCount(size_t tileIdx) const
+    {
+        return storedSampleCount(tileIdx, std::integral_constant<bool, Storage::IsDirect>());
+    }
+
+    // Mark a tile as updated, so that consumers of resolveTile() copy it again. Must be called with the tile claimed, after writing to it.
+    void commitTile(size_t tileIdx)
+    {
+        auto & generation = m_TileGenerations[tileIdx];
+        const auto next = generation.load(std::memory_order_relaxed) + 1;
+        generation.store(next == EmptyGeneration ? 0 : next, std::memory_order_release);
+    }
+
+    // \return The number of updates of a tile, or EmptyGeneration if the tile is stamped with another epoch than the given one
+    uint32_t tileGeneration(size_t tileIdx, uint32_t epoch) const
+    {
+        return m_TileEpochs[tileIdx] == epoch ? m_TileGenerations[tileIdx].load(std::memory_order_acquire) : EmptyGeneration;
+    }
+
+    Texel * tileDataPtr(size_t tileIdx)
+    {
+        return m_Data + tileIdx * m_nTilePixelCount;
+    }
+
+    const Texel * tileDataPtr(size_t tileIdx) const
+    {
+        return m_Data + tileIdx * m_nTilePixelCount;
+    }
+
+    AOVSet aovs() const
+    {
+        return m_AOVs;
+    }
+
+    // \return The first component of an AOV of a tile, the next ones follow every tilePixelCount() floats. nullptr if the AOV is disabled.
+    float * tileAOVPtr(size_t tileIdx, AOV aov)
+    {
+        return hasAOV(m_AOVs, aov) ? m_AOVData + (tileIdx * m_nAOVComponentCount + m_AOVOffsets[size_t(aov)]) * m_nTilePixelCount : nullptr;
+    }
+
+    const float * tileAOVPtr(size_t tileIdx, AOV aov) const
     {
+        return hasAOV(m_AOVs, aov) ? m_AOVData + (tileIdx * m_nAOVComponentCount + m_AOVOffsets[size_t(aov)]) * m_nTilePixelCount : nullptr;
     }
 
-    std::unique_lock<std::mutex> lockTile(size_t tileIdx) const
+    // Get the accumulated pixels of a tile, to be written by integrators and then given to storeTile().
+    // Direct storages return the tile data, compact storages decode the tile in the scratch buffer and return it.
+    // Must be called with the tile claimed.
+    //
+    // \arg scratch Array of tilePixelCount() pixels, unused by direct storages
+    float4 * loadTile(size_t tileIdx, float4 * scratch)
     {
-        return std::unique_lock<std::mutex>{ m_TileLocks[tileIdx] };
+        return loadTile(tileIdx, scratch, std::integral_constant<bool, Storage::IsDirect>());
     }
 
-    float4* tileDataPtr(size_t tileIdx)
+    // Encode back the pixels returned by loadTile(). Does nothing for direct storages. Must be called with the tile claimed.
+    void storeTile(size_t tileIdx, const float4 * pixels)
     {
-        return m_Data.data() + tileIdx * m_nTilePixelCount;
+        storeTile(tileIdx, pixels, std::integral_constant<bool, Storage::IsDirect>());
     }
 
-    const float4* tileDataPtr(size_t tileIdx) const
+    // Store the luminance accumulated in the pixels of a tile, to be given to accumulateLuminanceSquares() after the next pass.
+    //
+    // \arg pixels Pixels of the tile returned by loadTile()
+    // \arg outLuminance Array of tilePixelCount() values
+    void storeTileLuminance(const float4 * pixels, float * outLuminance) const
     {
-        return m_Data.data() + tileIdx * m_nTilePixelCount;
+        for (size_t pixelIdx = 0; pixelIdx < m_nTilePixelCount; ++pixelIdx) {
+            outLuminance[pixelIdx] = luminance(float3(pixels[pixelIdx]));
+        }
+    }
+
+    // Add the squared luminance of the last pass of a tile to its second moment, assuming the pass added one sample per pixel.
+    // Must be called with the tile claimed.
+    //
+    // \arg pixels Pixels of the tile returned by loadTile()
+    // \arg previousLuminance Luminance of the tile before the pass, as given by storeTileLuminance()
+    void accumulateLuminanceSquares(size_t tileIdx, const float4 * pixels, const float * previousLuminance)
+    {
+        const auto tileData = pixels;
+        const auto squares = m_LuminanceSquares + tileIdx * m_nTilePixelCount;
+        for (size_t pixelIdx = 0; pixelIdx < m_nTilePixelCount; ++pixelIdx) {
+            const auto sample = luminance(float3(tileData[pixelIdx])) - previousLuminance[pixelIdx];
+            squares[pixelIdx] += sample * sample;
+        }
+    }
+
+    // Estimate the noise of a tile: the mean over its pixels of the standard error of the pixel luminance, relative to the luminance.
+    // Dark pixels are compared to s_MinErrorLuminance instead, so that they are not considered infinitely noisy.
+    // Must be called with the tile claimed.
+    //
+    // \arg pixels Pixels of the tile returned by loadTile()
+    //
+    // \return A negative value if a pixel of the tile has less than two samples
+    float estimateTileError(size_t tileIdx, const float4 * pixels) const
+    {
+        const auto tileData = pixels;
+        const auto squares = m_LuminanceSquares + tileIdx * m_nTilePixelCount;
+
+        double errorSum = 0.;
+        size_t pixelCount = 0;
+        for (size_t pixelIdx = 0; pixelIdx < m_nTilePixelCount; ++pixelIdx) {
+            const auto sampleCount = tileData[pixelIdx].w;
+            if (sampleCount == 0.f) {
+                continue; // Outside of the image
+            }
+            if (sampleCount < 2.f) {
+                return -1.f;
+            }
+            const auto mean = luminance(float3(tileData[pixelIdx])) / sampleCount;
+            const auto variance = std::max(0.f, squares[pixelIdx] / sampleCount - mean * mean) * sampleCount / (sampleCount - 1.f);
+            errorSum += std::sqrt(variance / sampleCount) / std::max(mean, float(s_MinErrorLuminance));
+            ++pixelCount;
+        }
+        return pixelCount ? float(errorSum / pixelCount) : 0.f;
     }
 
     TileBounds tileBounds(size_t tileX, size_t tileY) const
@@ -72,27 +294,139 @@ public:
         return tileBounds(tileX, tileY);
     }
 
-    void copy(float4 * outImage) const
+    TilePixelLayout pixelLayout() const
     {
-        for (size_t tileIdx = 0u; tileIdx < m_nTileCount; ++tileIdx)
-        {
-            const auto bounds = tileBounds(tileIdx);
-            const auto tileData = tileDataPtr(tileIdx);
+        return m_PixelLayout;
+    }
+
+    // \return The tile coordinates of each pixel of a tile in storage order, packed with packPixelCoords(). nullptr for the row major layout.
+    const uint32_t * tilePixelCoords(size_t tileIdx) const
+    {
+        return m_PixelLayout == TilePixelLayout::RowMajor ? nullptr : pixelOrder(tileIdx).coords.data();
+    }
+
+    // Copy a tile to a contiguous image of the given pixel format. A tile stamped with another epoch than the given one is copied as empty (zeros).
+    // The tile should be claimed, otherwise the copy may contain partial samples.
+    void copyTile(size_t tileIdx, void * outImage, uint32_t epoch = 0, PixelFormat format = PixelFormat::RGBA32F, float exposureScale = 1.f) const
+    {
+        const auto bounds = tileBounds(tileIdx);
+        const auto isStale = m_TileEpochs[tileIdx] != epoch;
+        const auto pixelSize = pixelByteSize(format);
+        const auto indices = m_PixelLayout == TilePixelLayout::RowMajor ? nullptr : pixelOrder(tileIdx).indices.data();
 
-            for (size_t tileY = 0; tileY < bounds.countY; ++tileY) {
-                std::copy(tileData + tileY * m_nTileSize, tileData + tileY * m_nTileSize + bounds.countX, outImage + (bounds.beginY + tileY) * m_nImageWidth + bounds.beginX);
+        for (size_t tileY = 0; tileY < bounds.countY; ++tileY) {
+            const auto outRow = (char *)outImage + ((bounds.beginY + tileY) * m_nImageWidth + bounds.beginX) * pixelSize;
+            if (isStale) {
+                std::fill(outRow, outRow + bounds.countX * pixelSize, char(0));
+            }
+            else if (indices) {
+                copyTileRow(tileIdx, indices + tileY * bounds.countX, bounds.countX, format, exposureScale, outRow);
+            }
+            else {
+                copyTileRow(tileIdx, tileY * bounds.countX, bounds.countX, format, exposureScale, outRow, std::integral_constant<bool, Storage::IsDirect>());
             }
         }
     }
 
-    void clear()
+    // Copy an AOV of a tile to a contiguous image of aovComponentCount() floats per pixel: the mean of the samples for averaged AOVs,
+    // the value of the last sample otherwise. A tile stamped with another epoch than the given one is copied as empty (zeros).
+    // The tile should be claimed, otherwise the copy may contain partial samples.
+    void copyTileAOV(size_t tileIdx, AOV aov, float * outImage, uint32_t epoch = 0) const
+    {
+        const auto bounds = tileBounds(tileIdx);
+        const auto isStale = m_TileEpochs[tileIdx] != epoch;
+        const auto componentCount = aovComponentCount(aov);
+        const auto isAveraged = isAveragedAOV(aov);
+        const auto aovData = tileAOVPtr(tileIdx, aov);
+        const auto indices = m_PixelLayout == TilePixelLayout::RowMajor ? nullptr : pixelOrder(tileIdx).indices.data();
+
+        for (size_t tileY = 0; tileY < bounds.countY; ++tileY) {
+            const auto outRow = outImage + ((bounds.beginY + tileY) * m_nImageWidth + bounds.beginX) * componentCount;
+            if (isStale || !aovData) {
+                std::fill(outRow, outRow + bounds.countX * componentCount, 0.f);
+                continue;
+            }
+            for (size_t tileX = 0; tileX < bounds.countX; ++tileX) {
+                const auto pixelIdx = indices ? indices[tileX + tileY * bounds.countX] : tileX + tileY * bounds.countX;
+                const auto sampleCount = pixelSampleCount(tileIdx, pixelIdx, std::integral_constant<bool, Storage::IsDirect>());
+                const auto scale = isAveraged && sampleCount > 0.f ? 1.f / sampleCount : 1.f;
+                for (size_t component = 0; component < componentCount; ++component) {
+                    outRow[tileX * componentCount + component] = aovData[component * m_nTilePixelCount + pixelIdx] * scale;
+                }
+            }
+        }
+    }
+
+    // Copy the AOVs of a tile to the images of the AOVs that are not nullptr
+    void copyTileAOVs(size_t tileIdx, const AOVImages & aovImages, uint32_t epoch = 0) const
     {
-        for (size_t tileIdx = 0u; tileIdx < m_nTileCount; ++tileIdx)
+        for (size_t aovIdx = 0; aovIdx < AOVCount; ++aovIdx) {
+            if (aovImages[aovIdx]) {
+                copyTileAOV(tileIdx, AOV(aovIdx), aovImages[aovIdx], epoch);
+            }
+        }
+    }
+
+    // Copy a tile to a contiguous image if it has been updated since the generation last copied to this image.
+    // The tile should be claimed, otherwise the copy may contain partial samples.
+    //
+    // \arg resolvedGeneration Generation of the tile in the image, EmptyGeneration for an empty tile. Updated by the copy.
+    // \arg aovImages AOV images resolved with the tile, optional
+    //
+    // \return true if the tile has been copied
+    bool resolveTile(size_t tileIdx, void * outImage, uint32_t epoch, uint32_t & resolvedGeneration,
+        PixelFormat format = PixelFormat::RGBA32F, float exposureScale = 1.f, const AOVImages * aovImages = nullptr) const
+    {
+        const auto generation = tileGeneration(tileIdx, epoch);
+        if (generation == resolvedGeneration) {
+            return false;
+        }
+        copyTile(tileIdx, outImage, epoch, format, exposureScale);
+        if (aovImages) {
+            copyTileAOVs(tileIdx, *aovImages, epoch);
+        }
+        resolvedGeneration = generation;
+        return true;
+    }
+
+    // Copy the tiles to a contiguous image. Tiles stamped with another epoch than the given one are copied as empty.
+    void copy(void * outImage, uint32_t epoch = 0, PixelFormat format = PixelFormat::RGBA32F, float exposureScale = 1.f) const
+    {
+        // All tiles have the same cost: static blocks of tiles keep the scheduling overhead low
+        syncParallelLoop(uint32_t(m_nTileCount), ParallelLoopOptions{ ParallelSchedule::Static, 16 }, [&](uint32_t tileIdx, uint32_t threadId)
+        {
+            copyTile(tileIdx, outImage, epoch, format, exposureScale);
+        });
+    }
+
+    // Copy the tiles updated since the last resolve to a contiguous image, see resolveTile().
+    //
+    // \arg resolvedGenerations Generation of each tile in the image, updated by the copy
+    void resolve(void * outImage, uint32_t epoch, uint32_t * resolvedGenerations, PixelFormat format = PixelFormat::RGBA32F, float exposureScale = 1.f,
+        const AOVImages * aovImages = nullptr) const
+    {
+        // Most tiles are usually skipped: dynamic chunks balance the ones to copy
+        syncParallelLoop(uint32_t(m_nTileCount), ParallelLoopOptions{ ParallelSchedule::Dynamic, 16 }, [&](uint32_t tileIdx, uint32_t threadId)
+        {
+            resolveTile(tileIdx, outImage, epoch, resolvedGenerations[tileIdx], format, exposureScale, aovImages);
+        });
+    }
+
+    // Copy an AOV of all tiles to a contiguous image, see copyTileAOV()
+    void copyAOV(AOV aov, float * outImage, uint32_t epoch = 0) const
+    {
+        syncParallelLoop(uint32_t(m_nTileCount), ParallelLoopOptions{ ParallelSchedule::Static, 16 }, [&](uint32_t tileIdx, uint32_t threadId)
         {
-            const auto l = lockTile(tileIdx);
-            const auto bounds = tileBounds(tileIdx);
-            const auto tileData = tileDataPtr(tileIdx);
-            std::fill(tileData, tileData + m_nTilePixelCount, float4(0.f));
+            copyTileAOV(tileIdx, aov, outImage, epoch);
+        });
+    }
+
+    // Tiles are not cleared immediately but stamped with an epoch no renderer uses: acquireTile() clears them before they are written again,
+    // and they are copied as empty in the meantime. Must not be called while tiles are claimed.
+    void clear()
+    {
+        for (size_t tileIdx = 0; tileIdx < m_nTileCount; ++tileIdx) {
+            m_TileEpochs[tileIdx] = s_ClearedEpoch;
         }
     }
 
@@ -136,7 +470,182 @@ public:
         return m_nTileCount;
     }
 
+    // \return The size of the accumulated pixels and AOVs in memory
+    size_t dataByteSize() const
+    {
+        return m_nTileCount * (m_nTilePixelCount * (sizeof(Texel) + m_nAOVComponentCount * sizeof(float)) + (Storage::IsDirect ? 0 : sizeof(float)));
+    }
+
+    // \return The size of the framebuffer in memory, including the second moments, the per tile states and the pixel orders
+    size_t memoryByteSize() const
+    {
+        return dataByteSize() + m_nTileCount * m_nTilePixelCount * sizeof(float) +
+            m_nTileCount * (sizeof(std::atomic_bool) + 2 * sizeof(std::atomic_uint32_t)) +
+            std::accumulate(std::begin(m_PixelOrders), std::end(m_PixelOrders), size_t(0), [](size_t size, const TilePixelOrder & order)
+            {
+                return size + (order.coords.size() + order.indices.size()) * sizeof(uint32_t);
+            });
+    }
+
 private:
+    // Byte offsets of the arrays of the persistent memory
+    struct PersistentLayout
+    {
+        size_t data;
+        size_t tileSampleCounts;
+        size_t luminanceSquares;
+        size_t aovData;
+        size_t tileEpochs;
+        size_t byteSize;
+    };
+
+    static PersistentLayout persistentLayout(size_t tileCount, size_t tilePixelCount, size_t aovComponentCount)
+    {
+        const auto align = [](size_t offset) { return (offset + s_PersistentAlignment - 1) / s_PersistentAlignment * s_PersistentAlignment; };
+
+        PersistentLayout layout;
+        layout.data = 0;
+        layout.tileSampleCounts = align(layout.data + tileCount * tilePixelCount * sizeof(Texel));
+        layout.luminanceSquares = align(layout.tileSampleCounts + (Storage::IsDirect ? 0 : tileCount * sizeof(float)));
+        layout.aovData = align(layout.luminanceSquares + tileCount * tilePixelCount * sizeof(float));
+        layout.tileEpochs = align(layout.aovData + tileCount * tilePixelCount * aovComponentCount * sizeof(float));
+        layout.byteSize = align(layout.tileEpochs + tileCount * sizeof(uint32_t));
+        return layout;
+    }
+
+    size_t storedSampleCount(size_t tileIdx, std::true_type) const
+    {
+        const auto bounds = tileBounds(tileIdx);
+        const auto tileData = tileDataPtr(tileIdx);
+        float sampleCount = 0.f;
+        for (size_t pixelIdx = 0, count = bounds.countX * bounds.countY; pixelIdx < count; ++pixelIdx) {
+            sampleCount = std::max(sampleCount, tileData[pixelIdx].w);
+        }
+        return size_t(sampleCount);
+    }
+
+    size_t storedSampleCount(size_t tileIdx, std::false_type) const
+    {
+        return size_t(m_TileSampleCounts[tileIdx]);
+    }
+
+    float4 * loadTile(size_t tileIdx, float4 * scratch, std::true_type)
+    {
+        return tileDataPtr(tileIdx);
+    }
+
+    float4 * loadTile(size_t tileIdx, float4 * scratch, std::false_type)
+    {
+        const auto bounds = tileBounds(tileIdx);
+        const auto count = bounds.countX * bounds.countY;
+        const auto tileData = tileDataPtr(tileIdx);
+        const auto sampleCount = m_TileSampleCounts[tileIdx];
+        for (size_t pixelIdx = 0; pixelIdx < count; ++pixelIdx) {
+            scratch[pixelIdx] = float4(Storage::decode(tileData[pixelIdx]) * sampleCount, sampleCount);
+        }
+        std::fill(scratch + count, scratch + m_nTilePixelCount, float4(0.f));
+        return scratch;
+    }
+
+    void storeTile(size_t tileIdx, const float4 * pixels, std::true_type)
+    {
+    }
+
+    void storeTile(size_t tileIdx, const float4 * pixels, std::false_type)
+    {
+        const auto bounds = tileBounds(tileIdx);
+        const auto count = bounds.countX * bounds.countY;
+        const auto tileData = tileDataPtr(tileIdx);
+        const auto sampleCount = pixels[0].w; // The same for all pixels of the tile
+        const auto rcpSampleCount = sampleCount > 0.f ? 1.f / sampleCount : 0.f;
+        for (size_t pixelIdx = 0; pixelIdx < count; ++pixelIdx) {
+            tileData[pixelIdx] = Storage::encode(float3(pixels[pixelIdx]) * rcpSampleCount);
+        }
+        m_TileSampleCounts[tileIdx] = sampleCount;
+    }
+
+    void copyTileRow(size_t tileIdx, size_t offset, size_t count, PixelFormat format, float exposureScale, void * outRow, std::true_type) const
+    {
+        convertPixels(tileDataPtr(tileIdx) + offset, count, format, exposureScale, outRow);
+    }
+
+    // Decode the row by chunks to convert them to the output format
+    void copyTileRow(size_t tileIdx, size_t offset, size_t count, PixelFormat format, float exposureScale, void * outRow, std::false_type) const
+    {
+        const auto tileData = tileDataPtr(tileIdx) + offset;
+        const auto sampleCount = m_TileSampleCounts[tileIdx];
+        const auto pixelSize = pixelByteSize(format);
+
+        float4 pixels[s_RowChunkSize];
+        for (size_t begin = 0; begin < count; begin += s_RowChunkSize)
+        {
+            const auto chunkSize = std::min(count - begin, size_t(s_RowChunkSize));
+            for (size_t pixelIdx = 0; pixelIdx < chunkSize; ++pixelIdx) {
+                pixels[pixelIdx] = float4(Storage::decode(tileData[begin + pixelIdx]) * sampleCount, sampleCount);
+            }
+            convertPixels(pixels, chunkSize, format, exposureScale, (char *)outRow + begin * pixelSize);
+        }
+    }
+
+    // Gather the pixels of a row of a tile in Morton layout by chunks to convert them to the output format
+    //
+    // \arg indices Index in the tile of each pixel of the row
+    void copyTileRow(size_t tileIdx, const uint32_t * indices, size_t count, PixelFormat format, float exposureScale, void * outRow) const
+    {
+        const auto pixelSize = pixelByteSize(format);
+
+        float4 pixels[s_RowChunkSize];
+        for (size_t begin = 0; begin < count; begin += s_RowChunkSize)
+        {
+            const auto chunkSize = std::min(count - begin, size_t(s_RowChunkSize));
+            for (size_t pixelIdx = 0; pixelIdx < chunkSize; ++pixelIdx) {
+                pixels[pixelIdx] = loadPixel(tileIdx, indices[begin + pixelIdx], std::integral_constant<bool, Storage::IsDirect>());
+            }
+            convertPixels(pixels, chunkSize, format, exposureScale, (char *)outRow + begin * pixelSize);
+        }
+    }
+
+    float pixelSampleCount(size_t tileIdx, size_t pixelIdx, std::true_type) const
+    {
+        return tileDataPtr(tileIdx)[pixelIdx].w;
+    }
+
+    float pixelSampleCount(size_t tileIdx, size_t pixelIdx, std::false_type) const
+    {
+        return m_TileSampleCounts[tileIdx];
+    }
+
+    float4 loadPixel(size_t tileIdx, size_t pixelIdx, std::true_type) const
+    {
+        return tileDataPtr(tileIdx)[pixelIdx];
+    }
+
+    float4 loadPixel(size_t tileIdx, size_t pixelIdx, std::false_type) const
+    {
+        const auto sampleCount = m_TileSampleCounts[tileIdx];
+        return float4(Storage::decode(tileDataPtr(tileIdx)[pixelIdx]) * sampleCount, sampleCount);
+    }
+
+    const TilePixelOrder & pixelOrder(size_t tileIdx) const
+    {
+        const auto isPartialX = (tileIdx % m_nTileCountX) == m_nTileCountX - 1 && (m_nImageWidth % m_nTileSize);
+        const auto isPartialY = (tileIdx / m_nTileCountX) == m_nTileCountY - 1 && (m_nImageHeight % m_nTileSize);
+        return m_PixelOrders[(isPartialX ? 1 : 0) + (isPartialY ? 2 : 0)];
+    }
+
+    static const size_t s_RowChunkSize = 64;
+    static const size_t s_PersistentAlignment = 64;
+
+    static constexpr float s_MinErrorLuminance = 0.05f;
+    static constexpr uint32_t s_ClearedEpoch = std::numeric_limits<uint32_t>::max();
+
+    TilePixelLayout m_PixelLayout = TilePixelLayout::RowMajor;
+    TilePixelOrder m_PixelOrders[4]; // For full, right, bottom and bottom right tiles, Morton layout only
+
+    AOVSet m_AOVs = 0;
+    size_t m_nAOVComponentCount = 0; // Of all enabled AOVs
+    size_t m_AOVOffsets[AOVCount] = {}; // First component of each AOV in the AOVs of a tile
+
     size_t m_nTileSize = 0;
     size_t m_nTilePixelCount = 0;
     size_t m_nImageWidth = 0;
@@ -147,8 +656,21 @@ private:
     size_t m_nTileCountY = 0;
     size_t m_nTileCount = 0;
 
-    std::vector<float4> m_Data;
-    mutable std::vector<std::mutex> m_TileLocks;
+    // Persistent memory
+    std::unique_ptr<char[]> m_OwnedMemory; // When not provided by the caller
+    Texel * m_Data = nullptr;
+    float * m_TileSampleCounts = nullptr; // Sample count of the pixels of each tile, for compact storages only
+    float * m_AOVData = nullptr; // Components of the AOVs of each tile, each one stored for all the pixels of the tile
+    float * m_LuminanceSquares = nullptr; // Sum of the squared luminance of the samples of each pixel
+    std::atomic_uint32_t * m_TileEpochs = nullptr;
+
+    std::vector<std::atomic_bool> m_TileClaims;
+    std::vector<std::atomic_uint32_t> m_TileGenerations; // Incremented each time a tile is written
 };
 
+template<typename Storage>
+constexpr uint32_t BasicTiledFramebuffer<Storage>::EmptyGeneration;
+
+using TiledFramebuffer = BasicTiledFramebuffer<>;
+
 }
\ No newline at end of file
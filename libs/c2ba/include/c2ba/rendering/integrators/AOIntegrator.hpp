@@ -10,6 +10,30 @@ namespace c2ba
 
 class AOIntegrator : public Integrator
 {
+public:
+    // Embree API used to trace rays
+    enum class RayAPI
+    {
+        Single, // One rtcIntersect / rtcOccluded call per ray
+        Stream, // One stream of rays per tile, ambient occlusion rays in one stream per pixel
+        StreamSOA // One stream of rays per tile, ambient occlusion rays in one SOA packet per pixel (default)
+    };
+
+    // Must not be called while rendering
+    void setRayAPI(RayAPI api)
+    {
+        m_RayAPI = api;
+    }
+
+    RayAPI rayAPI() const
+    {
+        return m_RayAPI;
+    }
+
+    // Ray from the camera of params through the point uPixel of a pixel of the tile, in [0, 1)^2. Public for the kernel benchmarks.
+    Ray primaryRay(size_t pixelId, float2 uPixel, const RenderTileParams & params) const;
+
+private:
     void doPreprocess() override;
 
     void doRender(const RenderTileParams & params) override;
@@ -20,16 +44,19 @@ class AOIntegrator : public Integrator
 
     void renderStreamRaySOAAPI(const RenderTileParams & params);
 
-    Ray primaryRay(size_t pixelId, float2 uPixel, const RenderTileParams & params) const;
-
-    std::vector<std::mt19937> m_RandomGenerators;
     std::vector<Ray> m_Rays;
 
+    // Streams of the random numbers of a sample in deterministic mode
+    static const uint32_t s_PrimaryRayStream = 0;
+    static const uint32_t s_AORayStream = 1;
+
     static const size_t m_AORaySqrtCount = 4;
     static const size_t m_AORayCount = m_AORaySqrtCount * m_AORaySqrtCount;
 
     using AORayPacket = RaySOA<m_AORayCount>;
     std::vector<AORayPacket> m_AORays;
+
+    RayAPI m_RayAPI = RayAPI::StreamSOA;
 };
 
 }
\ No newline at end of file
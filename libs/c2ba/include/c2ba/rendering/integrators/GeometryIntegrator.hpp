@@ -13,7 +13,6 @@ class GeometryIntegrator : public Integrator
 
     void doRender(const RenderTileParams & params) override;
 
-    std::vector<std::mt19937> m_RandomGenerators;
 };
 
 }
\ No newline at end of file
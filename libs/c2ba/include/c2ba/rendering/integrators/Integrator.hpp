@@ -1,14 +1,99 @@
 #pragma once
 
+#include <memory>
+#include <atomic>
+#include <string>
+#include <random>
+#include <vector>
+#include <chrono>
+
 #include <c2ba/maths.hpp>
 #include <c2ba/scene/Scene.hpp>
+#include <c2ba/threads.hpp>
+#include <c2ba/Trace.hpp>
+#include <c2ba/rendering/TilePixelLayout.hpp>
+#include <c2ba/rendering/AOV.hpp>
+#include <c2ba/rendering/RenderCounters.hpp>
 
 namespace c2ba
 {
 
+// Random generator of the samples of a pixel, usable with the distributions of <random>. Either draws from the generator of the render thread,
+// or in deterministic mode is a PCG32 generator whose state only depends on the pixel, the sample index and the seed, see Integrator::setDeterministic().
+class SampleGenerator
+{
+public:
+    using result_type = uint32_t;
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return 0xFFFFFFFF;
+    }
+
+    explicit SampleGenerator(std::mt19937 & threadGenerator) :
+        m_pThreadGenerator(&threadGenerator)
+    {
+    }
+
+    // \arg stream Independent sequence of the sample, e.g. one for the primary ray and one for the ambient occlusion rays
+    SampleGenerator(uint64_t pixelIdx, uint64_t sampleIdx, uint32_t seed, uint32_t stream) :
+        m_Increment((uint64_t(stream) << 1) | 1)
+    {
+        // Seeded as pcg32_srandom_r(): the increment is applied to the state before the first output, so that streams
+        // of the same pixel and sample do not start from the same state. The stream is also hashed, LCGs only differing by
+        // their increment being correlated.
+        step();
+        m_State += mix(mix(mix(mix(seed) ^ pixelIdx) ^ sampleIdx) ^ stream);
+        step();
+    }
+
+    result_type operator ()()
+    {
+        if (m_pThreadGenerator) {
+            return result_type((*m_pThreadGenerator)());
+        }
+        // PCG-XSH-RR, ref: "PCG: A Family of Simple Fast Space-Efficient Statistically Good Algorithms for Random Number Generation" http://www.pcg-random.org/
+        const auto state = m_State;
+        step();
+        const auto xorShifted = uint32_t(((state >> 18u) ^ state) >> 27u);
+        const auto rotation = uint32_t(state >> 59u);
+        return (xorShifted >> rotation) | (xorShifted << ((32u - rotation) & 31u));
+    }
+
+private:
+    void step()
+    {
+        m_State = m_State * 6364136223846793005ull + m_Increment;
+    }
+
+    // SplitMix64 finalizer, so that neighbour pixels and samples get unrelated states
+    static uint64_t mix(uint64_t value)
+    {
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+    std::mt19937 * m_pThreadGenerator = nullptr;
+    uint64_t m_State = 0;
+    uint64_t m_Increment = 1;
+};
+
 class Integrator
 {
 public:
+    // Camera parameters. A new instance is published for each change so that render threads can keep using the previous one until they notice the change.
+    struct Camera
+    {
+        float4x4 rcpProjMatrix; // Screen to Cam
+        float4x4 rcpViewMatrix; // Cam to World
+    };
+
     virtual ~Integrator() = default;
 
     void setScene(const Scene & scene)
@@ -16,14 +101,20 @@ public:
         m_Scene = &scene;
     }
 
+    // Can be called while rendering
     void setProjMatrix(const float4x4 & projMatrix) // to be replace by a Sensor
     {
-        m_RcpProjMatrix = inverse(projMatrix);
+        auto camera = std::make_shared<Camera>(*std::atomic_load(&m_Camera));
+        camera->rcpProjMatrix = inverse(projMatrix);
+        std::atomic_store(&m_Camera, std::shared_ptr<const Camera>(std::move(camera)));
     }
 
+    // Can be called while rendering
     void setViewMatrix(const float4x4 & viewMatrix) // to be kept, define Sensor position
     {
-        m_RcpViewMatrix = inverse(viewMatrix);
+        auto camera = std::make_shared<Camera>(*std::atomic_load(&m_Camera));
+        camera->rcpViewMatrix = inverse(viewMatrix);
+        std::atomic_store(&m_Camera, std::shared_ptr<const Camera>(std::move(camera)));
     }
 
     void setFramebufferSize(size_t width, size_t height)
@@ -43,21 +134,48 @@ public:
         m_nThreadCount = count;
     }
 
+    // In deterministic mode, the random numbers of a sample only depend on its pixel, its index and the seed: images with the same number of samples
+    // per pixel are bit identical whatever the number of threads, the tile size and the order in which tiles are rendered. Otherwise each render thread
+    // draws from its own generator. Must not be called while rendering.
+    void setDeterministic(bool isDeterministic, uint32_t seed = 0)
+    {
+        m_bDeterministic = isDeterministic;
+        m_nSeed = seed;
+    }
+
+    bool isDeterministic() const
+    {
+        return m_bDeterministic;
+    }
+
     struct RenderTileParams
     {
         size_t threadId;
-        size_t tileId;
+        size_t tileId; // A tile can be rendered in multiple bands of pixels, each band having its own params
         size_t startSample;
         size_t sampleCount;
-        size_t beginX, beginY; // lower left pixel
-        size_t countX, countY; // number of pixels
+        size_t beginX, beginY; // lower left pixel of the tile
+        size_t countX, countY; // number of pixels of the tile
+        size_t beginPixel, endPixel; // Pixels to render, the whole tile or a band of it, as indices in the pixel order of the tile
+
+        const uint32_t * pixelCoords; // Tile coordinates of each pixel of the tile packed with packPixelCoords(), nullptr for row major pixels
+        float4 * outBuffer; // Pixels to render, pixelId indexes it from beginPixel
+        std::array<float *, AOVCount> aovBuffers; // First component of each AOV for the pixels to render, nullptr for disabled AOVs
+        size_t aovStride; // Number of floats between two components of an AOV
+
+        const std::atomic_uint32_t * epoch; // Current epoch of the renderer, nullptr if the tile cannot be canceled
+        uint32_t tileEpoch; // Epoch of the renderer when the tile has been started
 
-        float4 * outBuffer;
+        const Camera * camera; // Set by render()
+        uint64_t * pixelCostSum; // Set by render(): nanoseconds given to pixels by addPixelCost()
+
+        RenderCounters * counters; // Counters of the render threads indexed by threadId, nullptr to count nothing
     };
 
     // After all setters have been called, must be called to preprocess data required for rendering
     void preprocess()
     {
+        const TraceScope trace("preprocess");
         m_nTileCountX = m_nFramebufferWidth / m_nTileSize + size_t{ (m_nFramebufferWidth % m_nTileSize) != 0 };
         m_nTileCountY = m_nFramebufferHeight / m_nTileSize + size_t{ (m_nFramebufferHeight % m_nTileSize) != 0 };
         m_nTileCount = m_nTileCountX * m_nTileCountY;
@@ -65,12 +183,73 @@ public:
         doPreprocess();
     }
 
-    // Render pixels of a tile. This method should not be called by multiple threads at the same time for a given tile.
-    void render(const RenderTileParams & params)
+    // Render pixels of a tile, or of a band of rows of a tile. This method should not be called by multiple threads at the same time for the same pixels.
+    // The rendering is abandoned as soon as the epoch of the renderer differs from the epoch of the tile.
+    //
+    // With the AOV::RenderCost AOV, the time of the call is added to the cost of the pixels: the time given to pixels by the integrator
+    // with addPixelCost(), the remaining time being spread evenly over the pixels.
+    //
+    // \return false if the tile has been canceled, in which case outBuffer may contain partial samples and must be discarded
+    bool render(RenderTileParams params);
+
+    // To be checked by integrators between ray batches
+    static bool isCanceled(const RenderTileParams & params)
     {
-        doRender(params);
+        return params.epoch && params.epoch->load(std::memory_order_relaxed) != params.tileEpoch;
+    }
+
+protected:
+    // Run a Scene::intersect() query, counting its rays and the time spent in it in params.counters.
+    // Reading the clock twice costs about as much as tracing a single ray: queries of less than s_MinTimedRayCount rays are timed
+    // one in s_TimedQueryInterval per thread, their time being scaled by s_TimedQueryInterval.
+    //
+    // \arg rayCount Rays traced by the query
+    template<typename Query>
+    static auto countIntersect(const RenderTileParams & params, size_t rayCount, Query && query) -> decltype(query())
+    {
+        if (params.counters) {
+            params.counters->add(params.threadId, RenderCounter::PrimaryRays, rayCount);
+        }
+        const auto timeScale = queryTimeScale(params, rayCount, RenderCounter::IntersectTime);
+        const RenderCounterTimer timer(timeScale ? params.counters : nullptr, params.threadId, RenderCounter::IntersectTime, timeScale);
+        return query();
     }
 
+    // Same as countIntersect() for a Scene::occluded() query
+    template<typename Query>
+    static auto countOccluded(const RenderTileParams & params, size_t rayCount, Query && query) -> decltype(query())
+    {
+        if (params.counters) {
+            params.counters->add(params.threadId, RenderCounter::OcclusionRays, rayCount);
+        }
+        const auto timeScale = queryTimeScale(params, rayCount, RenderCounter::OccludedTime);
+        const RenderCounterTimer timer(timeScale ? params.counters : nullptr, params.threadId, RenderCounter::OccludedTime, timeScale);
+        return query();
+    }
+
+    static const size_t s_MinTimedRayCount = 16;
+    static const uint32_t s_TimedQueryInterval = 31; // Prime, so that the timed queries do not follow the rays of a pixel
+
+    // \return The scale of the time of a query added to counter, 0 if it is not timed
+    static uint64_t queryTimeScale(const RenderTileParams & params, size_t rayCount, RenderCounter counter);
+
+    // Generator of the random numbers of a pixel for the sample params.startSample, see setDeterministic()
+    //
+    // \arg stream Independent sequence of the sample in deterministic mode, ignored otherwise
+    // \arg threadGenerator Generator of the render thread, used outside of the deterministic mode
+    SampleGenerator sampleGenerator(size_t pixelId, uint32_t stream, const RenderTileParams & params, std::mt19937 & threadGenerator) const;
+
+    // Add time spent on a single pixel, e.g. tracing its rays alone, to its AOV::RenderCost. Integrators should only measure it if
+    // hasAOV(params, AOV::RenderCost).
+    static void addPixelCost(const RenderTileParams & params, size_t pixelId, uint64_t nanoseconds);
+
+    // Write the AOVs of the primary hit point of a pixel that do not depend on the integrator: depth, normal and geometry ID
+    void writePrimaryHitAOVs(const RenderTileParams & params, size_t pixelId, const Ray & ray) const;
+
+    // Create and seed m_RandomGenerators, one per render thread rather than per tile: bands of a split tile are rendered by several threads
+    // at the same time. To be called by doPreprocess() of integrators using them.
+    void seedThreadGenerators();
+
 private:
     virtual void doPreprocess() {}
 
@@ -79,8 +258,7 @@ private:
 protected:
     const Scene * m_Scene = nullptr;
 
-    float4x4 m_RcpProjMatrix; // Screen to Cam
-    float4x4 m_RcpViewMatrix; // Cam to World
+    std::shared_ptr<const Camera> m_Camera = std::make_shared<Camera>();
 
     size_t m_nFramebufferWidth = 0;
     size_t m_nFramebufferHeight = 0;
@@ -93,17 +271,137 @@ protected:
     size_t m_nTileCount;
 
     size_t m_nThreadCount;
+
+    bool m_bDeterministic = false;
+    uint32_t m_nSeed = 0;
+
+    std::vector<std::mt19937> m_RandomGenerators; // Generator of each render thread, see seedThreadGenerators()
 };
 
 inline size_t pixelCount(const Integrator::RenderTileParams & params)
 {
-    return params.countX * params.countY;
+    return params.endPixel - params.beginPixel;
+}
+
+inline bool hasAOV(const Integrator::RenderTileParams & params, AOV aov)
+{
+    return params.aovBuffers[size_t(aov)] != nullptr;
+}
+
+// Write the value of a sample to an AOV of a pixel: accumulated for averaged AOVs, overwritten otherwise. Does nothing if the AOV is disabled.
+//
+// \arg values aovComponentCount(aov) floats
+inline void writeAOV(const Integrator::RenderTileParams & params, AOV aov, size_t pixelId, const float * values)
+{
+    const auto buffer = params.aovBuffers[size_t(aov)];
+    if (!buffer) {
+        return;
+    }
+    const auto isAveraged = isAveragedAOV(aov);
+    for (size_t component = 0, count = aovComponentCount(aov); component < count; ++component) {
+        auto & value = buffer[component * params.aovStride + pixelId];
+        value = isAveraged ? value + values[component] : values[component];
+    }
+}
+
+inline void writeAOV(const Integrator::RenderTileParams & params, AOV aov, size_t pixelId, float value)
+{
+    writeAOV(params, aov, pixelId, &value);
+}
+
+inline void writeAOV(const Integrator::RenderTileParams & params, AOV aov, size_t pixelId, const float3 & value)
+{
+    const float values[] = { value.x, value.y, value.z };
+    writeAOV(params, aov, pixelId, values);
+}
+
+inline bool Integrator::render(RenderTileParams params)
+{
+    const auto camera = std::atomic_load(&m_Camera);
+    params.camera = camera.get();
+    params.pixelCostSum = nullptr;
+    if (!hasAOV(params, AOV::RenderCost)) {
+        doRender(params);
+        return !isCanceled(params);
+    }
+
+    uint64_t pixelCostSum = 0;
+    params.pixelCostSum = &pixelCostSum;
+    const auto renderStart = std::chrono::steady_clock::now();
+    doRender(params);
+    const auto renderTime = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - renderStart).count());
+    if (isCanceled(params)) {
+        return false;
+    }
+
+    const auto sharedCost = float(renderTime > pixelCostSum ? renderTime - pixelCostSum : 0) / pixelCount(params);
+    for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId) {
+        writeAOV(params, AOV::RenderCost, pixelId, sharedCost);
+    }
+    return true;
+}
+
+inline void Integrator::addPixelCost(const RenderTileParams & params, size_t pixelId, uint64_t nanoseconds)
+{
+    if (!params.pixelCostSum) {
+        return;
+    }
+    writeAOV(params, AOV::RenderCost, pixelId, float(nanoseconds));
+    *params.pixelCostSum += nanoseconds;
+}
+
+inline uint64_t Integrator::queryTimeScale(const RenderTileParams & params, size_t rayCount, RenderCounter counter)
+{
+    if (!params.counters) {
+        return 0;
+    }
+    if (rayCount >= s_MinTimedRayCount) {
+        return 1;
+    }
+    // Untimed single ray queries of this thread since the last timed one, for intersect() and occluded()
+    static thread_local uint32_t t_UntimedQueryCounts[2] = { 0, 0 };
+    auto & untimedQueryCount = t_UntimedQueryCounts[counter == RenderCounter::IntersectTime ? 0 : 1];
+    if (++untimedQueryCount < s_TimedQueryInterval) {
+        return 0;
+    }
+    untimedQueryCount = 0;
+    return s_TimedQueryInterval;
+}
+
+inline void Integrator::seedThreadGenerators()
+{
+    m_RandomGenerators.resize(m_nThreadCount);
+    for (size_t threadId = 0; threadId < m_nThreadCount; ++threadId) {
+        m_RandomGenerators[threadId].seed(uint32_t(threadId) * 1024u);
+    }
+}
+
+inline void Integrator::writePrimaryHitAOVs(const RenderTileParams & params, size_t pixelId, const Ray & ray) const
+{
+    if (ray.geomID == Ray::InvalidID) {
+        writeAOV(params, AOV::Depth, pixelId, 0.f);
+        writeAOV(params, AOV::Normal, pixelId, float3(0.f));
+        writeAOV(params, AOV::GeometryID, pixelId, -1.f);
+        return;
+    }
+    writeAOV(params, AOV::Depth, pixelId, ray.tfar * length(ray.dir));
+    if (hasAOV(params, AOV::Normal)) {
+        float3 N;
+        m_Scene->evalHitPoint(ray, Normal(N));
+        writeAOV(params, AOV::Normal, pixelId, N);
+    }
+    writeAOV(params, AOV::GeometryID, pixelId, float(ray.geomID));
 }
 
 template<typename Vec2T = size2>
 inline Vec2T pixelTileCoords(size_t pixelId, const Integrator::RenderTileParams & params)
 {
-    return Vec2T(pixelId % params.countX, pixelId / params.countX);
+    const auto tilePixelId = params.beginPixel + pixelId;
+    if (params.pixelCoords) {
+        const auto coords = params.pixelCoords[tilePixelId];
+        return Vec2T(coords & 0xFFFF, coords >> 16);
+    }
+    return Vec2T(tilePixelId % params.countX, tilePixelId / params.countX);
 }
 
 template<typename Vec2T = size2>
@@ -112,4 +410,13 @@ inline Vec2T pixelImageCoords(size_t pixelId, const Integrator::RenderTileParams
     return Vec2T(params.beginX, params.beginY) + pixelTileCoords<Vec2T>(pixelId, params);
 }
 
+inline SampleGenerator Integrator::sampleGenerator(size_t pixelId, uint32_t stream, const RenderTileParams & params, std::mt19937 & threadGenerator) const
+{
+    if (!m_bDeterministic) {
+        return SampleGenerator(threadGenerator);
+    }
+    const auto coords = pixelImageCoords(pixelId, params);
+    return SampleGenerator(uint64_t(coords.y) * m_nFramebufferWidth + coords.x, params.startSample, m_nSeed, stream);
+}
+
 }
\ No newline at end of file
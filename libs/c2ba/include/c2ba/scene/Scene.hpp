@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <tuple>
+#include <limits>
 #include <iostream>
 
 #include <embree2/rtcore_builder.h>
@@ -9,6 +10,7 @@
 #include <embree2/rtcore_ray.h>
 
 #include "../maths.hpp"
+#include "../Trace.hpp"
 
 namespace c2ba
 {
@@ -148,6 +150,7 @@ struct RTScene
             rtcSetBuffer2(m_rtcScene, geomId, RTC_INDEX_BUFFER, geometry.m_Triangles.data(), sizeof(SceneGeometry::Triangle) * std::get<0>(geometry.m_Meshes[i]),
                 sizeof(SceneGeometry::Triangle), std::get<1>(geometry.m_Meshes[i]));
         }
+        const TraceScope trace("BVH commit", "triangles", int64_t(geometry.m_Triangles.size()));
         rtcCommit(m_rtcScene);
     }
 
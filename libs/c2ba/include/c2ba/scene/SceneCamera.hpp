@@ -0,0 +1,44 @@
+#pragma once
+
+#include <limits>
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Scene.hpp"
+
+namespace c2ba
+{
+
+// Bounding sphere of a scene, to place cameras whatever its scale
+struct SceneCamera
+{
+    float3 center;
+    float radius;
+};
+
+inline SceneCamera frameScene(const SceneGeometry & geometry)
+{
+    float3 lower{ std::numeric_limits<float>::max() };
+    float3 upper{ std::numeric_limits<float>::lowest() };
+    for (const auto & vertex : geometry.m_Vertices) {
+        lower = min(lower, vertex.position);
+        upper = max(upper, vertex.position);
+    }
+    return{ 0.5f * (lower + upper), std::max(0.5f * length(upper - lower), 1e-3f) };
+}
+
+// View matrix of a camera orbiting around the scene
+inline float4x4 orbitViewMatrix(const SceneCamera & camera, float angle)
+{
+    const auto eye = camera.center + 1.5f * camera.radius * float3(sin(angle), 0.2f, cos(angle));
+    return glm::lookAt(eye, camera.center, float3(0, 1, 0));
+}
+
+// Projection matrix with a 70 degrees vertical field of view, near and far planes scaled to the scene
+inline float4x4 sceneProjMatrix(const SceneCamera & camera, size_t width, size_t height)
+{
+    return glm::perspective(glm::radians(70.f), float(width) / height, 0.01f * camera.radius, 10.f * camera.radius);
+}
+
+}
@@ -3,6 +3,15 @@
 #include <thread>
 #include <future>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <tuple>
+#include <utility>
+#include <algorithm>
 
 namespace c2ba
 {
@@ -13,12 +22,111 @@ inline uint32_t getHardwareConcurrency()
     return std::thread::hardware_concurrency();
 }
 
-// Run a functor asynchronously in multiple threads.
+// A pool of persistent worker threads. Each worker owns a deque of tasks: it pops its own tasks from the back (LIFO, cache friendly)
+// and steals tasks from the front of other workers' deques when its own deque is empty.
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(uint32_t threadCount);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator =(const ThreadPool &) = delete;
+
+    uint32_t threadCount() const
+    {
+        return uint32_t(m_Workers.size());
+    }
+
+    // \return The number of workers currently waiting for tasks
+    uint32_t idleThreadCount() const
+    {
+        return m_IdleThreadCount;
+    }
+
+    // Push a task to the pool. If called from a worker thread of the pool, the task goes to the deque of that worker,
+    // otherwise the deques are filled in round robin.
+    void submit(Task task);
+
+    // Pop or steal one pending task and execute it in the calling thread.
+    //
+    // \return true if a task has been executed
+    bool runPendingTask();
+
+    // Wait for a future to be ready. If called from a worker thread of the pool, pending tasks are executed while waiting
+    // so that nested parallel calls cannot block all workers.
+    void wait(std::future<void> & future);
+
+    // \return The index of the calling thread in the pool, or -1 if the calling thread is not a worker of this pool
+    int32_t workerIndex() const;
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool popTask(uint32_t workerIdx, Task & task);
+
+    void workerLoop(uint32_t workerIdx);
+
+    std::vector<std::unique_ptr<Worker>> m_Workers;
+    std::vector<std::thread> m_Threads;
+
+    std::atomic_uint32_t m_NextWorker{ 0 };
+    std::atomic<int32_t> m_PendingTaskCount{ 0 };
+    std::atomic_uint32_t m_IdleThreadCount{ 0 };
+
+    std::mutex m_SleepMutex;
+    std::condition_variable m_SleepCondition;
+    bool m_bStopped = false;
+};
+
+// \return The number of workers used by default for the global thread pool: one per logical thread, minus one kept for the main loop
+inline uint32_t getDefaultThreadCount()
+{
+    return getHardwareConcurrency() > 1u ? getHardwareConcurrency() - 1u : 1u;
+}
+
+// \return The global thread pool, created with getDefaultThreadCount() workers on first use
+ThreadPool & getThreadPool();
+
+// \return The number of workers of the global thread pool
+inline uint32_t getThreadCount()
+{
+    return getThreadPool().threadCount();
+}
+
+// Tasks that run until they are told to stop, e.g. TileRenderer's render threads, keep their worker busy: the tasks submitted meanwhile are only
+// run by the other workers. Such tasks must not occupy more workers than this at the same time, so that at least one worker is left for
+// asyncParallelRun() and asyncParallelLoop() calls (syncParallelLoop() also runs in the calling thread and never starves).
 //
-// \arg threadCount Number of threads to start
+// \return All workers of the global thread pool but one, 1 for a pool of one worker
+inline uint32_t getLongRunningThreadCount()
+{
+    return std::max(1u, getThreadCount() - 1u);
+}
+
+// Recreate the global thread pool with a given number of workers (0 means getDefaultThreadCount()).
+// Must not be called while tasks are running on the pool.
+void setThreadCount(uint32_t threadCount);
+
+// \return The index of the calling thread in the thread pool it works for, or -1 if the calling thread is not a worker.
+// Unlike getThreadPool().workerIndex(), never creates the global thread pool.
+int32_t getWorkerIndex();
+
+// Run a functor asynchronously in multiple tasks of the global thread pool.
+// Tasks that wait on each other must not be more numerous than getThreadCount(), otherwise some of them might never be scheduled.
+// Tasks that run until told to stop must not be more numerous than getLongRunningThreadCount().
+//
+// \arg threadCount Number of tasks to submit
 // \arg task Functor to execute
 //
-// \return A future that will be set when the last thread finishes. Allows synchronization by waiting on it.
+// \return A future that will be set when the last task finishes. Allows synchronization by waiting on it.
 template<typename TaskFunctor>
 inline std::future<void> asyncParallelRun(uint32_t threadCount, TaskFunctor task)
 {
@@ -31,24 +139,24 @@ inline std::future<void> asyncParallelRun(uint32_t threadCount, TaskFunctor task
         }
     };
     std::shared_ptr<SharedData> sharedData = std::make_shared<SharedData>();
+    auto & pool = getThreadPool();
     for (auto i = 0u; i < threadCount; ++i) {
-        std::thread t(
+        pool.submit(
             [i, task, sharedData]()
         {
             task(i);
         });
-        t.detach();
     }
     return sharedData->p.get_future();
 }
 
-// Run a functor asynchronously in multiple threads.
+// Run a functor asynchronously in multiple tasks of the global thread pool.
 //
-// \arg threadCount Number of threads to start
+// \arg threadCount Number of tasks to submit
 // \arg task Functor to execute
-// \arg completeCallback A callback that will be called by the last thread when it finishes.
+// \arg completeCallback A callback that will be called by the last task when it finishes.
 //
-// \return A future that will be set when the last thread finishes. Allows synchronization by waiting on it.
+// \return A future that will be set when the last task finishes. Allows synchronization by waiting on it.
 template<typename TaskFunctor, typename CompleteFunctor>
 inline std::future<void> asyncParallelRun(uint32_t threadCount, TaskFunctor task, CompleteFunctor completeCallback)
 {
@@ -66,78 +174,203 @@ inline std::future<void> asyncParallelRun(uint32_t threadCount, TaskFunctor task
     return asyncParallelRun(threadCount, [task, sharedData](size_t threadId) { task(threadId); });
 }
 
-// \brief Run in parallel a task and wait for it to finish.
+enum class ParallelSchedule
+{
+    Static, // Each thread gets one contiguous block of runs, or chunks of grainSize runs dealt round robin if grainSize > 1. Lowest overhead for uniform costs.
+    Dynamic, // Chunks of grainSize runs are handed out in order to the first thread asking for work.
+    Guided // Like Dynamic, but chunks start large and shrink down to grainSize as the loop progresses.
+};
+
+struct ParallelLoopOptions
+{
+    ParallelSchedule schedule;
+    uint32_t grainSize; // Minimal number of consecutive runs given to a thread
+    uint32_t threadCount; // Maximal number of threads working on the loop, 0 means getThreadCount()
+
+    ParallelLoopOptions(ParallelSchedule schedule = ParallelSchedule::Dynamic, uint32_t grainSize = 1, uint32_t threadCount = 0):
+        schedule(schedule), grainSize(grainSize), threadCount(threadCount)
+    {
+    }
+};
+
+namespace detail
+{
+
+struct ParallelLoopState
+{
+    const uint32_t runCount;
+    const uint32_t threadCount;
+    const uint32_t grainSize;
+    const ParallelSchedule schedule;
+
+    std::atomic_uint32_t nextThreadId{ 0 };
+    std::atomic_uint32_t nextRun{ 0 };
+    std::atomic_uint32_t runningThreadCount;
+    std::promise<void> promise;
+
+    ParallelLoopState(uint32_t runCount, const ParallelLoopOptions & options);
+
+    // Get the next range of runs [begin, end) to execute for a thread.
+    //
+    // \arg chunkIdx Number of chunks already processed by the thread, must be 0 for the first call
+    //
+    // \return false if there is no more work for the thread
+    bool nextChunk(uint32_t threadId, uint32_t & chunkIdx, uint32_t & begin, uint32_t & end);
+};
+
+template<typename T, typename Tuple, size_t... I>
+inline T makeFromTuple(const Tuple & args, std::index_sequence<I...>)
+{
+    return T{ std::get<I>(args)... };
+}
+
+template<typename ThreadStackData, typename TaskFunctor, typename... Args>
+struct ParallelLoop
+{
+    ParallelLoopState state;
+    TaskFunctor task;
+    std::tuple<Args...> args;
+
+    ParallelLoop(uint32_t runCount, const ParallelLoopOptions & options, TaskFunctor task, std::tuple<Args...> args):
+        state(runCount, options), task(std::move(task)), args(std::move(args))
+    {
+    }
+
+    // Claim a thread id and process runs until there is no more work for it.
+    // Threads arriving after all ids have been claimed return immediately, so the loop never waits for a thread that is not scheduled.
+    //
+    // \return false if all thread ids were already claimed
+    bool runThread()
+    {
+        const auto threadId = state.nextThreadId++;
+        if (threadId >= state.threadCount) {
+            return false;
+        }
+
+        {
+            auto threadData = makeFromTuple<ThreadStackData>(args, std::index_sequence_for<Args...>{});
+            uint32_t chunkIdx = 0, begin, end;
+            while (state.nextChunk(threadId, chunkIdx, begin, end)) {
+                for (auto runId = begin; runId < end; ++runId) {
+                    task(runId, threadId, threadData);
+                }
+            }
+        } // Destroy the stack data before signaling completion
+
+        if (--state.runningThreadCount == 0) {
+            state.promise.set_value();
+        }
+        return true;
+    }
+};
+
+template<typename ThreadStackData, typename TaskFunctor, typename... Args>
+inline auto makeParallelLoop(uint32_t runCount, const ParallelLoopOptions & options, TaskFunctor task, Args&&... args)
+{
+    return std::make_shared<ParallelLoop<ThreadStackData, TaskFunctor, std::decay_t<Args>...>>(
+        runCount, options, std::move(task), std::make_tuple(std::forward<Args>(args)...));
+}
+
+}
+
+// \brief Run in parallel a task on the global thread pool.
 //
-// \tparam ThreadStackData A class that will be instanciated by each thread before running the task. The instance will be passed to the task. It must be default constructible.
-// \tparam TaskFunctor The task functor that will be executed. Prototype must be (void)(size_t runId, size_t threadId, ThreadStackData & data)
-// \tparam InitThreadStackDataFunctor A functor to initialize the stack data. Prototype must be (void)(ThreadStackData & data)
+// \tparam ThreadStackData A class that will be instanciated once by each thread before running its first run. The instance will be passed to the task.
+//  It is brace-initialized with a copy of args... and destroyed before the returned future is set.
+// \tparam TaskFunctor The task functor that will be executed. Prototype must be (void)(uint32_t runId, uint32_t threadId, ThreadStackData & data)
 //
 // \arg runCount Number of time the task should be executed
-// \arg threadCount Number of threads to be used (not counting the calling thread, that will wait others to finish their tasks)
+// \arg options Scheduling policy, grain size and maximal number of threads (threadId is always lower than the thread count)
 // \arg task The task to execute
-// \arg init The functor to initialize the stack data
+// \arg args Arguments used to construct the stack data of each thread
 //
+// \return A future that will be set when all runs are done.
 template<typename ThreadStackData, typename TaskFunctor, typename... Args>
-inline std::future<void> asyncParallelLoop(uint32_t runCount, uint32_t threadCount, TaskFunctor task, Args&&... args)
+inline std::future<void> asyncParallelLoop(uint32_t runCount, const ParallelLoopOptions & options, TaskFunctor task, Args&&... args)
 {
-    const auto blockSize = std::max(1u, runCount / threadCount);
-
-    std::shared_ptr<std::atomic_uint> nextBatch = std::make_shared<std::atomic_uint>(0);
-    auto batchProcess = [blockSize, nextBatch, runCount, task, init](uint32_t threadID)
-    {
-        ThreadStackData threadData{ std::forward<Args>(args)... };
-        init(threadData); // Here I would have prefer to use constructor with variadic template arguments but GCC has this bug https://gcc.gnu.org/bugzilla/show_bug.cgi?id=47226
-        while (true) {
-            auto batchID = (*nextBatch)++;
-            auto taskID = batchID * blockSize;
-
-            if (taskID >= runCount) {
-                break;
-            }
+    auto loop = detail::makeParallelLoop<ThreadStackData>(runCount, options, std::move(task), std::forward<Args>(args)...);
+    auto future = loop->state.promise.get_future();
 
-            auto end = std::min(taskID + blockSize, runCount);
+    auto & pool = getThreadPool();
+    for (auto i = 0u; i < loop->state.threadCount; ++i) {
+        pool.submit([loop]() { loop->runThread(); });
+    }
 
-            while (taskID < end) {
-                task(taskID, threadID, threadData);
-                ++taskID;
-            }
-        }
-    };
+    return future;
+}
 
-    return asyncParallelRun(threadCount, batchProcess);
+template<typename ThreadStackData, typename TaskFunctor, typename... Args>
+inline std::future<void> asyncParallelLoop(uint32_t runCount, uint32_t threadCount, TaskFunctor task, Args&&... args)
+{
+    return asyncParallelLoop<ThreadStackData>(runCount, ParallelLoopOptions{ ParallelSchedule::Dynamic, 1, threadCount }, std::move(task), std::forward<Args>(args)...);
 }
 
-// Specialization for no stack data
+// Specialization for no stack data. Prototype of the task must be (void)(uint32_t runId, uint32_t threadId)
 template<typename TaskFunctor>
-inline std::future<void> asyncParallelLoop(uint32_t runCount, uint32_t threadCount, TaskFunctor task)
+inline std::future<void> asyncParallelLoop(uint32_t runCount, const ParallelLoopOptions & options, TaskFunctor task)
 {
     struct NullStruct {};
-    return asyncParallelLoop<NullStruct>(runCount, threadCount, [&](size_t taskId, size_t threadId, NullStruct &) { task(taskId, threadId); });
+    return asyncParallelLoop<NullStruct>(runCount, options, [task](uint32_t runId, uint32_t threadId, NullStruct &) { task(runId, threadId); });
 }
 
+template<typename TaskFunctor>
+inline std::future<void> asyncParallelLoop(uint32_t runCount, uint32_t threadCount, TaskFunctor task)
+{
+    return asyncParallelLoop(runCount, ParallelLoopOptions{ ParallelSchedule::Dynamic, 1, threadCount }, std::move(task));
+}
 
 template<typename TaskFunctor>
 inline void syncParallelRun(uint32_t threadCount, TaskFunctor task)
 {
-    asyncParallelRun(threadCount, task).wait();
+    auto future = asyncParallelRun(threadCount, task);
+    getThreadPool().wait(future);
 }
 
 template<typename TaskFunctor, typename CompleteFunctor>
 inline void syncParallelRun(uint32_t threadCount, TaskFunctor task, CompleteFunctor completeCallback)
 {
-    asyncParallelRun(threadCount, task, completeCallback).wait();
+    auto future = asyncParallelRun(threadCount, task, completeCallback);
+    getThreadPool().wait(future);
+}
+
+// \brief Run in parallel a task and wait for it to finish. Same parameters as asyncParallelLoop().
+//
+// The calling thread takes part in the loop, and only idle workers of the pool are asked for help:
+// the loop completes even if all workers are busy with long running tasks (e.g. TileRenderer's render threads).
+template<typename ThreadStackData, typename TaskFunctor, typename... Args>
+inline void syncParallelLoop(uint32_t runCount, const ParallelLoopOptions & options, TaskFunctor task, Args&&... args)
+{
+    auto loop = detail::makeParallelLoop<ThreadStackData>(runCount, options, std::move(task), std::forward<Args>(args)...);
+    auto future = loop->state.promise.get_future();
+
+    auto & pool = getThreadPool();
+    const auto helperCount = std::min(loop->state.threadCount - 1, pool.idleThreadCount());
+    for (auto i = 0u; i < helperCount; ++i) {
+        pool.submit([loop]() { loop->runThread(); });
+    }
+
+    while (loop->runThread()) {}
+
+    pool.wait(future);
 }
 
 template<typename ThreadStackData, typename TaskFunctor, typename... Args>
 inline void syncParallelLoop(uint32_t runCount, uint32_t threadCount, TaskFunctor task, Args&&... args)
 {
-    asyncParallelLoop<ThreadStackData>(runCount, threadCount, task, std::forward<Args>(args)...).wait();
+    syncParallelLoop<ThreadStackData>(runCount, ParallelLoopOptions{ ParallelSchedule::Dynamic, 1, threadCount }, std::move(task), std::forward<Args>(args)...);
+}
+
+template<typename TaskFunctor>
+inline void syncParallelLoop(uint32_t runCount, const ParallelLoopOptions & options, TaskFunctor task)
+{
+    struct NullStruct {};
+    syncParallelLoop<NullStruct>(runCount, options, [task](uint32_t runId, uint32_t threadId, NullStruct &) { task(runId, threadId); });
 }
 
 template<typename TaskFunctor>
 inline void syncParallelLoop(uint32_t runCount, uint32_t threadCount, TaskFunctor task)
 {
-    asyncParallelLoop(runCount, threadCount, task).wait();
+    syncParallelLoop(runCount, ParallelLoopOptions{ ParallelSchedule::Dynamic, 1, threadCount }, std::move(task));
 }
 
-}
\ No newline at end of file
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+
 namespace c2ba
 {
 
@@ -28,4 +32,13 @@ inline RAII<DeleteFunc> finally(DeleteFunc && delF)
     return RAII<DeleteFunc>(delF);
 }
 
+// Reverse the order of the rows of an image, e.g. between the bottom up images of the renderer and the top down images of files
+template<typename T>
+inline void flipRows(T * image, size_t rowLength, size_t rowCount)
+{
+    for (size_t y = 0; y < rowCount / 2; ++y) {
+        std::swap_ranges(image + y * rowLength, image + (y + 1) * rowLength, image + (rowCount - 1 - y) * rowLength);
+    }
+}
+
 }
\ No newline at end of file
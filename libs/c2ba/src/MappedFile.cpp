@@ -0,0 +1,120 @@
+#include "c2ba/MappedFile.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace c2ba
+{
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string & path, size_t byteSize, bool discardContent)
+{
+    close();
+    if (!byteSize) {
+        return false;
+    }
+
+    const auto file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        discardContent ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    // The mapping extends the file with zeros
+    const auto mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, DWORD(uint64_t(byteSize) >> 32), DWORD(byteSize & 0xFFFFFFFF), nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+
+    const auto data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, byteSize);
+    if (!data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_FileHandle = file;
+    m_MappingHandle = mapping;
+    m_pData = data;
+    m_nByteSize = byteSize;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_pData) {
+        UnmapViewOfFile(m_pData);
+        CloseHandle(m_MappingHandle);
+        CloseHandle(m_FileHandle);
+    }
+    m_pData = nullptr;
+    m_MappingHandle = nullptr;
+    m_FileHandle = nullptr;
+    m_nByteSize = 0;
+}
+
+bool MappedFile::flush()
+{
+    return m_pData && FlushViewOfFile(m_pData, m_nByteSize) && FlushFileBuffers(m_FileHandle);
+}
+
+#else
+
+bool MappedFile::open(const std::string & path, size_t byteSize, bool discardContent)
+{
+    close();
+    if (!byteSize) {
+        return false;
+    }
+
+    const auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | (discardContent ? O_TRUNC : 0), 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Extended files are sparse: pages never written take no disk space
+    if (ftruncate(fd, off_t(byteSize)) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    const auto data = mmap(nullptr, byteSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+
+    m_FileDescriptor = fd;
+    m_pData = data;
+    m_nByteSize = byteSize;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_pData) {
+        munmap(m_pData, m_nByteSize);
+        ::close(m_FileDescriptor);
+    }
+    m_pData = nullptr;
+    m_FileDescriptor = -1;
+    m_nByteSize = 0;
+}
+
+bool MappedFile::flush()
+{
+    return m_pData && msync(m_pData, m_nByteSize, MS_SYNC) == 0;
+}
+
+#endif
+
+}
@@ -0,0 +1,161 @@
+#include "c2ba/SharedMemory.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace c2ba
+{
+
+#ifdef _WIN32
+
+bool SharedMemory::create(const std::string & name, size_t byteSize)
+{
+    close();
+    if (!byteSize) {
+        return false;
+    }
+
+    // Backed by the paging file, the mapping lives as long as a process has a handle on it
+    const auto mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(uint64_t(byteSize) >> 32), DWORD(byteSize & 0xFFFFFFFF), name.c_str());
+    if (!mapping) {
+        return false;
+    }
+    const auto alreadyExists = GetLastError() == ERROR_ALREADY_EXISTS;
+
+    const auto data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, byteSize);
+    if (!data) {
+        CloseHandle(mapping);
+        return false;
+    }
+    if (alreadyExists) {
+        ZeroMemory(data, byteSize); // The segment of another renderer is not replaced but reused
+    }
+
+    m_MappingHandle = mapping;
+    m_pData = data;
+    m_nByteSize = byteSize;
+    m_Name = name;
+    m_bCreator = true;
+    return true;
+}
+
+bool SharedMemory::openReadOnly(const std::string & name)
+{
+    close();
+
+    const auto mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+    if (!mapping) {
+        return false;
+    }
+
+    const auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (!data || !VirtualQuery(data, &info, sizeof(info))) {
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        CloseHandle(mapping);
+        return false;
+    }
+
+    m_MappingHandle = mapping;
+    m_pData = data;
+    m_nByteSize = info.RegionSize; // Rounded up to pages
+    m_Name = name;
+    m_bCreator = false;
+    return true;
+}
+
+void SharedMemory::close()
+{
+    if (m_pData) {
+        UnmapViewOfFile(m_pData);
+        CloseHandle(m_MappingHandle);
+    }
+    m_pData = nullptr;
+    m_MappingHandle = nullptr;
+    m_nByteSize = 0;
+    m_Name.clear();
+    m_bCreator = false;
+}
+
+#else
+
+bool SharedMemory::create(const std::string & name, size_t byteSize)
+{
+    close();
+    if (!byteSize) {
+        return false;
+    }
+
+    shm_unlink(name.c_str()); // Processes mapping the previous segment keep it until they unmap it
+    const auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    const auto data = ftruncate(fd, off_t(byteSize)) == 0 ? mmap(nullptr, byteSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (data == MAP_FAILED) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    m_FileDescriptor = fd;
+    m_pData = data;
+    m_nByteSize = byteSize;
+    m_Name = name;
+    m_bCreator = true;
+    return true;
+}
+
+bool SharedMemory::openReadOnly(const std::string & name)
+{
+    close();
+
+    const auto fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat status;
+    const auto data = fstat(fd, &status) == 0 && status.st_size > 0 ? mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (data == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+
+    m_FileDescriptor = fd;
+    m_pData = data;
+    m_nByteSize = size_t(status.st_size);
+    m_Name = name;
+    m_bCreator = false;
+    return true;
+}
+
+void SharedMemory::close()
+{
+    if (m_pData) {
+        munmap(m_pData, m_nByteSize);
+        ::close(m_FileDescriptor);
+        if (m_bCreator) {
+            shm_unlink(m_Name.c_str());
+        }
+    }
+    m_pData = nullptr;
+    m_FileDescriptor = -1;
+    m_nByteSize = 0;
+    m_Name.clear();
+    m_bCreator = false;
+}
+
+#endif
+
+}
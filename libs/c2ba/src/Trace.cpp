@@ -0,0 +1,194 @@
+#include "c2ba/Trace.hpp"
+#include "c2ba/threads.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+namespace c2ba
+{
+
+namespace
+{
+
+// Fields are atomic so that the exporting thread can read events while their thread overwrites them, without data race
+struct TraceEvent
+{
+    std::atomic<const char *> name{ nullptr };
+    std::atomic<const char *> argName{ nullptr };
+    std::atomic<int64_t> argValue{ 0 };
+    std::atomic<uint64_t> beginTimestamp{ 0 };
+    std::atomic<uint64_t> endTimestamp{ 0 };
+};
+
+// Ring buffer of the events of a thread. Only its thread writes it.
+struct TraceBuffer
+{
+    TraceBuffer(size_t capacity, uint32_t threadIndex, int32_t workerIndex) :
+        events(new TraceEvent[capacity]), capacity(capacity), threadIndex(threadIndex), workerIndex(workerIndex)
+    {
+    }
+
+    std::unique_ptr<TraceEvent[]> events;
+    size_t capacity;
+    uint32_t threadIndex;
+    int32_t workerIndex; // At the time of the first event of the thread
+    std::atomic<uint64_t> eventCount{ 0 }; // Recorded since the creation of the buffer, the last capacity ones are kept
+};
+
+std::atomic<bool> s_bTracing{ false };
+std::atomic<uint64_t> s_nTracingStartTimestamp{ 0 };
+std::atomic<size_t> s_nEventCapacity{ 1 << 16 };
+
+// Buffers are never destroyed: events of threads that have exited can still be exported, and a thread never writes to freed memory
+std::mutex s_BuffersMutex;
+std::vector<std::unique_ptr<TraceBuffer>> s_Buffers;
+
+thread_local TraceBuffer * t_pTraceBuffer = nullptr;
+
+TraceBuffer & getThreadTraceBuffer()
+{
+    if (!t_pTraceBuffer) {
+        std::unique_lock<std::mutex> l{ s_BuffersMutex };
+        s_Buffers.emplace_back(std::make_unique<TraceBuffer>(std::max(size_t(1), s_nEventCapacity.load()), uint32_t(s_Buffers.size()), getWorkerIndex()));
+        t_pTraceBuffer = s_Buffers.back().get();
+    }
+    return *t_pTraceBuffer;
+}
+
+void writeJsonString(std::ostream & out, const char * str)
+{
+    out << '"';
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\') {
+            out << '\\';
+        }
+        out << *str;
+    }
+    out << '"';
+}
+
+}
+
+void startTracing(size_t eventCapacity)
+{
+    s_nEventCapacity = eventCapacity;
+    s_nTracingStartTimestamp = traceTimestamp();
+    s_bTracing = true;
+}
+
+void stopTracing()
+{
+    s_bTracing = false;
+}
+
+bool isTracing()
+{
+    return s_bTracing.load(std::memory_order_relaxed);
+}
+
+void recordTraceEvent(const char * name, const char * argName, int64_t argValue, uint64_t beginTimestamp, uint64_t endTimestamp)
+{
+    auto & buffer = getThreadTraceBuffer();
+    const auto eventIdx = buffer.eventCount.load(std::memory_order_relaxed);
+    auto & event = buffer.events[eventIdx % buffer.capacity];
+    event.name.store(name, std::memory_order_relaxed);
+    event.argName.store(argName, std::memory_order_relaxed);
+    event.argValue.store(argValue, std::memory_order_relaxed);
+    event.beginTimestamp.store(beginTimestamp, std::memory_order_relaxed);
+    event.endTimestamp.store(endTimestamp, std::memory_order_relaxed);
+    // Publish the event: a reader acquiring the count sees its fields
+    buffer.eventCount.store(eventIdx + 1, std::memory_order_release);
+}
+
+void writeChromeTrace(std::ostream & out)
+{
+    std::vector<TraceBuffer *> buffers;
+    {
+        std::unique_lock<std::mutex> l{ s_BuffersMutex };
+        for (const auto & buffer : s_Buffers) {
+            buffers.emplace_back(buffer.get());
+        }
+    }
+
+    // Events of previous tracing sessions are filtered by time rather than cleared, clearing would race with their threads
+    const auto startTimestamp = s_nTracingStartTimestamp.load();
+    const auto toMicroseconds = [startTimestamp](uint64_t timestamp)
+    {
+        return double(timestamp - startTimestamp) * 0.001;
+    };
+
+    // Microseconds with a nanosecond resolution
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out.setf(std::ios::fixed, std::ios::floatfield);
+    out.precision(3);
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    auto first = true;
+    const auto separator = [&]()
+    {
+        out << (first ? "\n" : ",\n");
+        first = false;
+    };
+
+    for (const auto * buffer : buffers) {
+        const auto tid = buffer->threadIndex + 1;
+        separator();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\"";
+        if (buffer->workerIndex >= 0) {
+            out << "worker " << buffer->workerIndex;
+        }
+        else {
+            out << "thread " << buffer->threadIndex;
+        }
+        out << "\"}}";
+        separator();
+        // Keep threads in creation order in the viewers
+        out << "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"sort_index\":" << tid << "}}";
+
+        const auto eventCount = buffer->eventCount.load(std::memory_order_acquire);
+        const auto firstEventIdx = eventCount > buffer->capacity ? eventCount - buffer->capacity : 0;
+        for (auto eventIdx = firstEventIdx; eventIdx < eventCount; ++eventIdx) {
+            const auto & event = buffer->events[eventIdx % buffer->capacity];
+            const auto beginTimestamp = event.beginTimestamp.load(std::memory_order_relaxed);
+            const auto endTimestamp = event.endTimestamp.load(std::memory_order_relaxed);
+            const auto * name = event.name.load(std::memory_order_relaxed);
+            if (!name || beginTimestamp < startTimestamp || endTimestamp < beginTimestamp) {
+                continue;
+            }
+
+            separator();
+            out << "{\"name\":";
+            writeJsonString(out, name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << toMicroseconds(beginTimestamp) <<
+                ",\"dur\":" << double(endTimestamp - beginTimestamp) * 0.001;
+            if (const auto * argName = event.argName.load(std::memory_order_relaxed)) {
+                out << ",\"args\":{";
+                writeJsonString(out, argName);
+                out << ":" << event.argValue.load(std::memory_order_relaxed) << "}";
+            }
+            out << "}";
+        }
+    }
+
+    out << "\n]}\n";
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+bool writeChromeTrace(const std::string & path)
+{
+    std::ofstream out{ path };
+    if (!out) {
+        return false;
+    }
+    writeChromeTrace(out);
+    return bool(out);
+}
+
+}
@@ -0,0 +1,116 @@
+#include "rendering/ExrTileWriter.hpp"
+
+#include <OpenEXR/ImfTiledOutputFile.h>
+#include <OpenEXR/ImfHeader.h>
+#include <OpenEXR/ImfChannelList.h>
+#include <OpenEXR/ImfFrameBuffer.h>
+#include <OpenEXR/ImfTileDescription.h>
+#include <OpenEXR/ImfCompression.h>
+#include <OpenEXR/ImfThreading.h>
+
+namespace c2ba
+{
+
+struct ExrTileWriter::File
+{
+    Imf::TiledOutputFile file;
+
+    File(const std::string & path, const Imf::Header & header) :
+        file(path.c_str(), header, Imf::globalThreadCount())
+    {
+    }
+};
+
+static Imf::Compression exrCompression(ExrCompression compression)
+{
+    switch (compression) {
+    case ExrCompression::None:
+        return Imf::NO_COMPRESSION;
+    case ExrCompression::Piz:
+        return Imf::PIZ_COMPRESSION;
+    default:
+        return Imf::ZIP_COMPRESSION;
+    }
+}
+
+static std::string aovChannelName(AOV aov, size_t component)
+{
+    static const char * suffixes[] = { ".X", ".Y", ".Z" };
+    return aovComponentCount(aov) == 1 ? std::string(aovName(aov)) : std::string(aovName(aov)) + suffixes[component];
+}
+
+ExrTileWriter::ExrTileWriter(const std::string & path, size_t imageWidth, size_t imageHeight, size_t tileSize, AOVSet aovs,
+    ExrCompression compression, uint32_t threadCount) :
+    m_nImageWidth(imageWidth), m_nImageHeight(imageHeight), m_nTileSize(tileSize), m_AOVs(aovs)
+{
+    Imf::Header header(static_cast<int>(imageWidth), static_cast<int>(imageHeight));
+    header.setTileDescription(Imf::TileDescription(unsigned(tileSize), unsigned(tileSize), Imf::ONE_LEVEL));
+    header.compression() = exrCompression(compression);
+    header.lineOrder() = Imf::RANDOM_Y; // Tiles written out of order are not buffered by OpenEXR
+
+    for (const auto channel : { "R", "G", "B" }) {
+        header.channels().insert(channel, Imf::Channel(Imf::HALF));
+    }
+    for (size_t aovIdx = 0; aovIdx < AOVCount; ++aovIdx) {
+        if (hasAOV(aovs, AOV(aovIdx))) {
+            for (size_t component = 0; component < aovComponentCount(AOV(aovIdx)); ++component) {
+                header.channels().insert(aovChannelName(AOV(aovIdx), component), Imf::Channel(Imf::FLOAT));
+            }
+        }
+    }
+
+    if (threadCount) {
+        m_nPreviousThreadCount = Imf::globalThreadCount();
+        Imf::setGlobalThreadCount(int(threadCount));
+    }
+    try {
+        m_File = std::make_unique<File>(path, header);
+    }
+    catch (...) {
+        if (m_nPreviousThreadCount >= 0) {
+            Imf::setGlobalThreadCount(m_nPreviousThreadCount);
+        }
+        throw;
+    }
+}
+
+ExrTileWriter::~ExrTileWriter()
+{
+    m_File.reset(); // Its last tiles may still be compressed by the pool
+    if (m_nPreviousThreadCount >= 0) {
+        Imf::setGlobalThreadCount(m_nPreviousThreadCount);
+    }
+}
+
+void ExrTileWriter::writeTileRow(size_t tileY, const float4 * pixels, const AOVImages & aovImages)
+{
+    // Slices are addressed with image coordinates: their base is the pixel (0, 0), above the rows we have
+    const auto beginY = tileY * m_nTileSize;
+
+    Imf::FrameBuffer frameBuffer;
+    const auto colorBase = (const char *)pixels - beginY * m_nImageWidth * sizeof(float4);
+    const char * colorChannels[] = { "R", "G", "B" };
+    for (size_t component = 0; component < 3; ++component) {
+        frameBuffer.insert(colorChannels[component], Imf::Slice(Imf::FLOAT, (char *)colorBase + component * sizeof(float),
+            sizeof(float4), m_nImageWidth * sizeof(float4)));
+    }
+
+    for (size_t aovIdx = 0; aovIdx < AOVCount; ++aovIdx) {
+        if (!hasAOV(m_AOVs, AOV(aovIdx))) {
+            continue;
+        }
+        const auto componentCount = aovComponentCount(AOV(aovIdx));
+        const auto pixelSize = componentCount * sizeof(float);
+        const auto aovBase = (const char *)aovImages[aovIdx] - beginY * m_nImageWidth * pixelSize;
+        for (size_t component = 0; component < componentCount; ++component) {
+            frameBuffer.insert(aovChannelName(AOV(aovIdx), component), Imf::Slice(Imf::FLOAT, (char *)aovBase + component * sizeof(float),
+                pixelSize, m_nImageWidth * pixelSize));
+        }
+    }
+
+    auto & file = m_File->file;
+    file.setFrameBuffer(frameBuffer);
+    file.writeTiles(0, file.numXTiles() - 1, int(tileY), int(tileY)); // Compressed in parallel by the OpenEXR thread pool
+}
+
+}
@@ -0,0 +1,150 @@
+#include "rendering/PixelFormat.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <array>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define C2BA_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace c2ba
+{
+
+namespace
+{
+
+// sRGB encoding of linear values in [0, 1], indexed by the square root of the value: the sRGB curve is steepest near black, where
+// uniform linear samples would be more than one 10 bits step apart. Indexed this way its slope stays below 1.5 and the lookup
+// error below a fifth of a 10 bits step, over the whole range.
+struct SRGBTable
+{
+    static const size_t Size = 4096;
+
+    std::array<uint8_t, Size> values8;
+    std::array<uint16_t, Size> values10;
+
+    SRGBTable()
+    {
+        for (size_t i = 0; i < Size; ++i)
+        {
+            const auto root = double(i) / (Size - 1);
+            const auto linear = root * root;
+            const auto srgb = linear <= 0.0031308 ? 12.92 * linear : 1.055 * std::pow(linear, 1. / 2.4) - 0.055;
+            values8[i] = uint8_t(srgb * 255. + 0.5);
+            values10[i] = uint16_t(srgb * 1023. + 0.5);
+        }
+    }
+};
+
+const SRGBTable & getSRGBTable()
+{
+    static const SRGBTable table;
+    return table;
+}
+
+inline uint32_t packRGBA8(const SRGBTable & table, const int32_t * indices, bool hasSamples)
+{
+    return uint32_t(table.values8[indices[0]]) | (uint32_t(table.values8[indices[1]]) << 8) | (uint32_t(table.values8[indices[2]]) << 16) |
+        (hasSamples ? 0xFF000000u : 0u);
+}
+
+inline uint32_t packRGB10A2(const SRGBTable & table, const int32_t * indices, bool hasSamples)
+{
+    return uint32_t(table.values10[indices[0]]) | (uint32_t(table.values10[indices[1]]) << 10) | (uint32_t(table.values10[indices[2]]) << 20) |
+        (hasSamples ? 0xC0000000u : 0u);
+}
+
+// Compute the sRGB table indices of the mean of the samples of each pixel, then pack them with Pack
+template<typename Pack>
+void encodePixelsScalar(const float4 * pixels, size_t count, float exposureScale, uint32_t * outPixels, Pack pack)
+{
+    const auto & table = getSRGBTable();
+    int32_t indices[4];
+
+    for (size_t pixelIdx = 0; pixelIdx < count; ++pixelIdx)
+    {
+        const auto & pixel = pixels[pixelIdx];
+        const auto hasSamples = pixel.w > 0.f;
+        const auto factor = hasSamples ? exposureScale / pixel.w : 0.f;
+        for (size_t channel = 0; channel < 3; ++channel) {
+            const auto scaled = pixel[channel] * factor;
+            const auto value = scaled > 0.f ? std::min(scaled, 1.f) : 0.f; // NaN gives 0, as with the operand order of _mm_max_ps() below
+            indices[channel] = int32_t(std::sqrt(value) * (SRGBTable::Size - 1) + 0.5f);
+        }
+        outPixels[pixelIdx] = pack(table, indices, hasSamples);
+    }
+}
+
+#ifdef C2BA_SSE2
+// Same as encodePixelsScalar(), one pixel per SSE register
+template<typename Pack>
+void encodePixelsSSE2(const float4 * pixels, size_t count, float exposureScale, uint32_t * outPixels, Pack pack)
+{
+    const auto & table = getSRGBTable();
+    alignas(16) int32_t indices[4];
+
+    const auto scale = _mm_set1_ps(exposureScale);
+    const auto zero = _mm_setzero_ps();
+    const auto one = _mm_set1_ps(1.f);
+    const auto tableScale = _mm_set1_ps(float(SRGBTable::Size - 1));
+    const auto half = _mm_set1_ps(0.5f);
+
+    for (size_t pixelIdx = 0; pixelIdx < count; ++pixelIdx)
+    {
+        const auto pixel = _mm_loadu_ps(&pixels[pixelIdx].x);
+        const auto sampleCount = _mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 3, 3, 3));
+        const auto hasSamples = _mm_cmpgt_ps(sampleCount, zero);
+        // Pixels without samples get a null factor instead of an infinite one
+        const auto factor = _mm_and_ps(hasSamples, _mm_div_ps(scale, sampleCount));
+        // _mm_max_ps() returns its second operand when one is NaN: NaN channels are encoded as 0
+        const auto color = _mm_min_ps(_mm_max_ps(_mm_mul_ps(pixel, factor), zero), one);
+        _mm_store_si128((__m128i *)indices, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sqrt_ps(color), tableScale), half)));
+        outPixels[pixelIdx] = pack(table, indices, (_mm_movemask_ps(hasSamples) & 1) != 0);
+    }
+}
+#endif
+
+// Convert pixels with Encode, the encoder of the pixels of 32 bits formats: the scalar and SIMD conversions only differ by it
+template<typename Encode>
+void convertPixels(const float4 * pixels, size_t count, PixelFormat format, float exposureScale, void * outPixels, Encode encode)
+{
+    switch (format)
+    {
+    case PixelFormat::RGBA32F:
+        std::memcpy(outPixels, pixels, count * sizeof(float4));
+        break;
+    case PixelFormat::RGBA8:
+        encode(pixels, count, exposureScale, (uint32_t *)outPixels, packRGBA8);
+        break;
+    case PixelFormat::RGB10A2:
+        encode(pixels, count, exposureScale, (uint32_t *)outPixels, packRGB10A2);
+        break;
+    }
+}
+
+}
+
+void convertPixels(const float4 * pixels, size_t count, PixelFormat format, float exposureScale, void * outPixels)
+{
+    convertPixels(pixels, count, format, exposureScale, outPixels, [](const float4 * pixels, size_t count, float exposureScale, uint32_t * outPixels, auto pack)
+    {
+#ifdef C2BA_SSE2
+        encodePixelsSSE2(pixels, count, exposureScale, outPixels, pack);
+#else
+        encodePixelsScalar(pixels, count, exposureScale, outPixels, pack);
+#endif
+    });
+}
+
+void convertPixelsScalar(const float4 * pixels, size_t count, PixelFormat format, float exposureScale, void * outPixels)
+{
+    convertPixels(pixels, count, format, exposureScale, outPixels, [](const float4 * pixels, size_t count, float exposureScale, uint32_t * outPixels, auto pack)
+    {
+        encodePixelsScalar(pixels, count, exposureScale, outPixels, pack);
+    });
+}
+
+}
@@ -1,23 +1,29 @@
 #include "rendering/integrators/AOIntegrator.hpp"
+#include "Trace.hpp"
 #include <iostream>
 namespace c2ba
 {
 
 void AOIntegrator::doPreprocess()
 {
-    m_RandomGenerators.resize(m_nTileCount);
-    for (size_t tileId = 0; tileId < m_nTileCount; ++tileId) {
-        m_RandomGenerators[tileId].seed(tileId * 1024u);
-    }
+    seedThreadGenerators();
     m_Rays.resize((m_AORaySqrtCount * m_AORaySqrtCount * m_nTileSize * m_nTileSize + m_nTileSize * m_nTileSize) * m_nThreadCount, Ray{});
     m_AORays.resize(m_nTileSize * m_nTileSize * m_nThreadCount);
 }
 
 void AOIntegrator::doRender(const RenderTileParams & params)
 {
-    //renderSingleRayAPI(params);
-    //renderStreamRayAPI(params);
-    renderStreamRaySOAAPI(params);
+    switch (m_RayAPI) {
+    case RayAPI::Single:
+        renderSingleRayAPI(params);
+        break;
+    case RayAPI::Stream:
+        renderStreamRayAPI(params);
+        break;
+    default:
+        renderStreamRaySOAAPI(params);
+        break;
+    }
 }
 
 Ray AOIntegrator::primaryRay(size_t pixelId, float2 uPixel, const RenderTileParams & params) const
@@ -25,9 +31,9 @@ Ray AOIntegrator::primaryRay(size_t pixelId, float2 uPixel, const RenderTilePara
     const auto pixelCoords = pixelImageCoords<float2>(pixelId, params);
     const auto rasterPos = pixelCoords + uPixel;
     const auto ndcPos = float2(-1.f) + 2.f * rasterPos * m_RcpFramebufferSize;
-    const auto viewSpacePos = divideW<float4>(m_RcpProjMatrix * float4(ndcPos, -1.f, 1.f));
-    const auto worldSpacePos = divideW<float3>(m_RcpViewMatrix * viewSpacePos);
-    const auto viewOrigin = float3(m_RcpViewMatrix[3]);
+    const auto viewSpacePos = divideW<float4>(params.camera->rcpProjMatrix * float4(ndcPos, -1.f, 1.f));
+    const auto worldSpacePos = divideW<float3>(params.camera->rcpViewMatrix * viewSpacePos);
+    const auto viewOrigin = float3(params.camera->rcpViewMatrix[3]);
 
     return Ray{ viewOrigin, worldSpacePos - viewOrigin };
 }
@@ -37,12 +43,24 @@ void AOIntegrator::renderSingleRayAPI(const RenderTileParams & params)
     const auto aoRayCount = m_AORaySqrtCount * m_AORaySqrtCount;
 
     std::uniform_real_distribution<float> d{ 0, 1 };
-    auto & g = m_RandomGenerators[params.tileId];
+    auto & threadGenerator = m_RandomGenerators[params.threadId];
+    const auto measureCost = hasAOV(params, AOV::RenderCost);
 
     for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId)
     {
+        if (isCanceled(params)) {
+            return;
+        }
+
+        // Pixels are traced one by one: all their time is their own
+        const auto pixelStart = measureCost ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+        auto g = sampleGenerator(pixelId, s_PrimaryRayStream, params, threadGenerator);
         auto ray = primaryRay(pixelId, float2(d(g), d(g)), params);
-        if (m_Scene->intersect(ray))
+        const auto hit = countIntersect(params, 1, [&]() { return m_Scene->intersect(ray); });
+        writePrimaryHitAOVs(params, pixelId, ray);
+
+        if (hit)
         {
             float3 N;
             m_Scene->evalHitPoint(ray, Normal(N));
@@ -50,6 +68,7 @@ void AOIntegrator::renderSingleRayAPI(const RenderTileParams & params)
             float3 Tx, Ty;
             makeOrthonormals(N, Tx, Ty);
 
+            g = sampleGenerator(pixelId, s_AORayStream, params, threadGenerator);
             float visibility = 0.f;
             for (size_t aoRayIdx = 0; aoRayIdx < aoRayCount; ++aoRayIdx)
             {
@@ -57,14 +76,21 @@ void AOIntegrator::renderSingleRayAPI(const RenderTileParams & params)
                 const float3 worldDir = localDir.x * Tx + localDir.y * Ty + localDir.z * N;
 
                 Ray aoRay{ hitPoint(ray), worldDir, 0.01f, 100.f };
-                if (!m_Scene->occluded(aoRay))
+                if (!countOccluded(params, 1, [&]() { return m_Scene->occluded(aoRay); }))
                     visibility += 1.f;
             }
 
             params.outBuffer[pixelId] += float4(float3(visibility / aoRayCount), 1);
+            writeAOV(params, AOV::AmbientOcclusion, pixelId, visibility / aoRayCount);
         }
-        else
+        else {
             params.outBuffer[pixelId] += float4(float3(0), 1);
+            writeAOV(params, AOV::AmbientOcclusion, pixelId, 0.f);
+        }
+
+        if (measureCost) {
+            addPixelCost(params, pixelId, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - pixelStart).count());
+        }
     }
 }
 
@@ -75,18 +101,25 @@ void AOIntegrator::renderStreamRayAPI(const RenderTileParams & params)
 
     std::uniform_real_distribution<float> d{ 0, 1 };
 
-    auto & g = m_RandomGenerators[params.tileId];
+    auto & threadGenerator = m_RandomGenerators[params.threadId];
+    const auto measureCost = hasAOV(params, AOV::RenderCost); // Ambient occlusion rays of each pixel are traced in their own stream
 
     for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId) {
+        auto g = sampleGenerator(pixelId, s_PrimaryRayStream, params, threadGenerator);
         rays[pixelId] = primaryRay(pixelId, float2(d(g), d(g)), params);
     }
 
-    m_Scene->intersect(rays, pixelCount(params), RayProperties::Coherent);
+    countIntersect(params, pixelCount(params), [&]() { m_Scene->intersect(rays, pixelCount(params), RayProperties::Coherent); });
+
+    if (isCanceled(params)) {
+        return;
+    }
 
     for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId)
     {
         auto & ray = rays[pixelId];
         auto * aoRays = rays + m_nTileSize * m_nTileSize + pixelId * aoRayCount;
+        writePrimaryHitAOVs(params, pixelId, ray);
 
         if (ray.geomID != RTC_INVALID_GEOMETRY_ID)
         {
@@ -96,6 +129,7 @@ void AOIntegrator::renderStreamRayAPI(const RenderTileParams & params)
             float3 Tx, Ty;
             makeOrthonormals(N, Tx, Ty);
 
+            auto g = sampleGenerator(pixelId, s_AORayStream, params, threadGenerator);
             for (size_t aoRayIdx = 0; aoRayIdx < aoRayCount; ++aoRayIdx)
             {
                 const float3 localDir = sampleHemisphereCosine(d(g), d(g));
@@ -117,8 +151,20 @@ void AOIntegrator::renderStreamRayAPI(const RenderTileParams & params)
 
     for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId)
     {
+        if (isCanceled(params)) {
+            return;
+        }
+
         auto * aoRays = rays + m_nTileSize * m_nTileSize + pixelId * aoRayCount;
-        m_Scene->occluded(aoRays, aoRayCount, RayProperties::Coherent);
+        const auto occludedStart = measureCost ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+        countOccluded(params, aoRayCount, [&]() { m_Scene->occluded(aoRays, aoRayCount, RayProperties::Coherent); });
+        if (measureCost) {
+            addPixelCost(params, pixelId, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - occludedStart).count());
+        }
+    }
+
+    if (isCanceled(params)) {
+        return;
     }
 
     for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId)
@@ -135,6 +181,7 @@ void AOIntegrator::renderStreamRayAPI(const RenderTileParams & params)
         }
 
         params.outBuffer[pixelId] += float4(float3(visibility / aoRayCount), 1);
+        writeAOV(params, AOV::AmbientOcclusion, pixelId, visibility / aoRayCount);
     }
 }
 
@@ -146,56 +193,90 @@ void AOIntegrator::renderStreamRaySOAAPI(const RenderTileParams & params)
 
     std::uniform_real_distribution<float> d{ 0, 1 };
 
-    auto & g = m_RandomGenerators[params.tileId];
+    auto & threadGenerator = m_RandomGenerators[params.threadId];
 
-    for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId) {
-        rays[pixelId] = primaryRay(pixelId, float2(d(g), d(g)), params);
-    }
+    {
+        const TraceScope trace("primary rays", "tile", params.tileId);
+        for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId) {
+            auto g = sampleGenerator(pixelId, s_PrimaryRayStream, params, threadGenerator);
+            rays[pixelId] = primaryRay(pixelId, float2(d(g), d(g)), params);
+        }
 
-    m_Scene->intersect(rays, pixelCount(params), RayProperties::Coherent);
+        countIntersect(params, pixelCount(params), [&]() { m_Scene->intersect(rays, pixelCount(params), RayProperties::Coherent); });
+    }
 
-    for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId)
-    {
-        memset(&aoRays[pixelId], 0, sizeof(aoRays[pixelId]));
-        std::fill(aoRays[pixelId].tnear, aoRays[pixelId].tnear + m_AORayCount, 1.f);
-        std::fill(aoRays[pixelId].mask, aoRays[pixelId].mask + m_AORayCount, 0xFFFFFFFF);
-        std::fill(aoRays[pixelId].geomID, aoRays[pixelId].geomID + m_AORayCount, Ray::InvalidID);
-        std::fill(aoRays[pixelId].instID, aoRays[pixelId].instID + m_AORayCount, Ray::InvalidID);
-        std::fill(aoRays[pixelId].primID, aoRays[pixelId].primID + m_AORayCount, Ray::InvalidID);
+    if (isCanceled(params)) {
+        return;
     }
 
-    for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId)
     {
-        auto & ray = rays[pixelId];
+        const TraceScope trace("ambient occlusion rays", "tile", params.tileId);
+        for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId)
+        {
+            memset(&aoRays[pixelId], 0, sizeof(aoRays[pixelId]));
+            std::fill(aoRays[pixelId].tnear, aoRays[pixelId].tnear + m_AORayCount, 1.f);
+            std::fill(aoRays[pixelId].mask, aoRays[pixelId].mask + m_AORayCount, 0xFFFFFFFF);
+            std::fill(aoRays[pixelId].geomID, aoRays[pixelId].geomID + m_AORayCount, Ray::InvalidID);
+            std::fill(aoRays[pixelId].instID, aoRays[pixelId].instID + m_AORayCount, Ray::InvalidID);
+            std::fill(aoRays[pixelId].primID, aoRays[pixelId].primID + m_AORayCount, Ray::InvalidID);
+        }
 
-        if (ray.geomID != RTC_INVALID_GEOMETRY_ID)
+        for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId)
         {
-            std::fill(aoRays[pixelId].tnear, aoRays[pixelId].tnear + m_AORayCount, 0.01f);
-            std::fill(aoRays[pixelId].tfar, aoRays[pixelId].tfar + m_AORayCount, 100.f);
+            auto & ray = rays[pixelId];
+            writePrimaryHitAOVs(params, pixelId, ray);
 
-            const auto aoOrg = hitPoint(ray);
-            std::fill(aoRays[pixelId].orgx, aoRays[pixelId].orgx + m_AORayCount, aoOrg.x);
-            std::fill(aoRays[pixelId].orgy, aoRays[pixelId].orgy + m_AORayCount, aoOrg.y);
-            std::fill(aoRays[pixelId].orgz, aoRays[pixelId].orgz + m_AORayCount, aoOrg.z);
+            if (ray.geomID != RTC_INVALID_GEOMETRY_ID)
+            {
+                std::fill(aoRays[pixelId].tnear, aoRays[pixelId].tnear + m_AORayCount, 0.01f);
+                std::fill(aoRays[pixelId].tfar, aoRays[pixelId].tfar + m_AORayCount, 100.f);
+
+                const auto aoOrg = hitPoint(ray);
+                std::fill(aoRays[pixelId].orgx, aoRays[pixelId].orgx + m_AORayCount, aoOrg.x);
+                std::fill(aoRays[pixelId].orgy, aoRays[pixelId].orgy + m_AORayCount, aoOrg.y);
+                std::fill(aoRays[pixelId].orgz, aoRays[pixelId].orgz + m_AORayCount, aoOrg.z);
+
+                float3 N;
+                m_Scene->evalHitPoint(ray, Normal(N));
+                float3 Tx, Ty;
+                makeOrthonormals(N, Tx, Ty);
+
+                auto g = sampleGenerator(pixelId, s_AORayStream, params, threadGenerator);
+                for (size_t aoRayIdx = 0; aoRayIdx < aoRayCount; ++aoRayIdx)
+                {
+                    const float3 localDir = sampleHemisphereCosine(d(g), d(g));
+                    const float3 worldDir = localDir.x * Tx + localDir.y * Ty + localDir.z * N;
+
+                    aoRays[pixelId].dirx[aoRayIdx] = worldDir.x;
+                    aoRays[pixelId].diry[aoRayIdx] = worldDir.y;
+                    aoRays[pixelId].dirz[aoRayIdx] = worldDir.z;
+                }
+            }
+        }
 
-            float3 N;
-            m_Scene->evalHitPoint(ray, Normal(N));
-            float3 Tx, Ty;
-            makeOrthonormals(N, Tx, Ty);
+        if (isCanceled(params)) {
+            return;
+        }
 
-            for (size_t aoRayIdx = 0; aoRayIdx < aoRayCount; ++aoRayIdx)
+        if (hasAOV(params, AOV::RenderCost)) {
+            // One stream per pixel to measure the cost of its ambient occlusion rays, less coherent than a stream per tile
+            countOccluded(params, pixelCount(params) * m_AORayCount, [&]()
             {
-                const float3 localDir = sampleHemisphereCosine(d(g), d(g));
-                const float3 worldDir = localDir.x * Tx + localDir.y * Ty + localDir.z * N;
-
-                aoRays[pixelId].dirx[aoRayIdx] = worldDir.x;
-                aoRays[pixelId].diry[aoRayIdx] = worldDir.y;
-                aoRays[pixelId].dirz[aoRayIdx] = worldDir.z;
-            }
+                for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId) {
+                    const auto occludedStart = std::chrono::steady_clock::now();
+                    m_Scene->occluded(&aoRays[pixelId], 1, RayProperties::Coherent);
+                    addPixelCost(params, pixelId, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - occludedStart).count());
+                }
+            });
+        }
+        else {
+            countOccluded(params, pixelCount(params) * m_AORayCount, [&]() { m_Scene->occluded(&aoRays[0], pixelCount(params), RayProperties::Coherent); });
         }
     }
 
-    m_Scene->occluded(&aoRays[0], pixelCount(params), RayProperties::Coherent);
+    if (isCanceled(params)) { // Partial samples are never accumulated
+        return;
+    }
 
     //RaySOAPtrs aoSOAPtrs = raySOAPtrs(aoRays[0]);
     //for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId)
@@ -204,6 +285,7 @@ void AOIntegrator::renderStreamRaySOAAPI(const RenderTileParams & params)
     //    advance(aoSOAPtrs, sizeof(AORayPacket));
     //}
 
+    const TraceScope trace("accumulate", "tile", params.tileId);
     for (size_t pixelId = 0, count = pixelCount(params); pixelId < count; ++pixelId)
     {
         float visibility = 0.f;
@@ -217,6 +299,7 @@ void AOIntegrator::renderStreamRaySOAAPI(const RenderTileParams & params)
         }
 
         params.outBuffer[pixelId] += float4(float3(visibility / aoRayCount), 1);
+        writeAOV(params, AOV::AmbientOcclusion, pixelId, visibility / aoRayCount);
     }
 }
 
@@ -1,4 +1,5 @@
 #include "scene/Scene.hpp"
+#include "threads.hpp"
 
 #include <iostream>
 #include <filesystem>
@@ -60,9 +61,10 @@ static void loadMaterial(const aiMaterial* aimaterial, const fs::path& basePath,
     //geometry.addMaterial(std::move(material));
 }
 
-static void loadMesh(const aiMesh* aimesh, uint32_t materialOffset, SceneGeometry& geometry) {
-    std::vector<SceneGeometry::Vertex> vertices;
-    std::vector<SceneGeometry::Triangle> triangles;
+// Write the vertices and triangles of a mesh at given offsets of the geometry arrays, which must already be allocated
+static void loadMesh(const aiMesh* aimesh, uint32_t materialOffset, size_t vertexOffset, size_t triangleOffset, SceneGeometry& geometry) {
+    auto * vertices = geometry.m_Vertices.data() + vertexOffset;
+    auto * triangles = geometry.m_Triangles.data() + triangleOffset;
 
 #ifdef _DEBUG
     //mesh.m_MaterialID = 0;
@@ -70,13 +72,12 @@ static void loadMesh(const aiMesh* aimesh, uint32_t materialOffset, SceneGeometr
     const auto m_MaterialID = materialOffset + aimesh->mMaterialIndex;
 #endif
 
-    vertices.reserve(aimesh->mNumVertices);
     for (size_t vertexIdx = 0; vertexIdx < aimesh->mNumVertices; ++vertexIdx) {
         const aiVector3D* pPosition = aimesh->HasPositions() ? &aimesh->mVertices[vertexIdx] : &aiZERO;
         const aiVector3D* pNormal = aimesh->HasNormals() ? &aimesh->mNormals[vertexIdx] : &aiZERO;
         const aiVector3D* pTexCoords = aimesh->HasTextureCoords(0) ? &aimesh->mTextureCoords[0][vertexIdx] : &aiZERO;
 
-        vertices.emplace_back(
+        vertices[vertexIdx] = SceneGeometry::Vertex(
             float3(pPosition->x, pPosition->y, pPosition->z),
             float3(pNormal->x, pNormal->y, pNormal->z),
             float2(pTexCoords->x, pTexCoords->y));
@@ -89,13 +90,11 @@ static void loadMesh(const aiMesh* aimesh, uint32_t materialOffset, SceneGeometr
         //}
     }
 
-    triangles.reserve(aimesh->mNumFaces);
     for (size_t triangleIdx = 0; triangleIdx < aimesh->mNumFaces; ++triangleIdx) {
         const aiFace& face = aimesh->mFaces[triangleIdx];
-        triangles.emplace_back(face.mIndices[0], face.mIndices[1], face.mIndices[2]);
+        triangles[triangleIdx] = SceneGeometry::Triangle(
+            uint32_t(vertexOffset + face.mIndices[0]), uint32_t(vertexOffset + face.mIndices[1]), uint32_t(vertexOffset + face.mIndices[2]));
     }
-
-    geometry.append(vertices.data(), vertices.size(), triangles.data(), triangles.size());
 }
 
 void loadAssimpScene(const aiScene* aiscene, const std::string& filepath, SceneGeometry& geometry) {
@@ -108,13 +107,31 @@ void loadAssimpScene(const aiScene* aiscene, const std::string& filepath, SceneG
         loadMaterial(aiscene->mMaterials[materialIdx], path.parent_path(), geometry);
     }
 
-    //geometry.m_TriangleMeshs.reserve(geometry.m_TriangleMeshs.size() + aiscene->mNumMeshes);
+    // Allocate all meshes up front so that they can be converted in parallel, each one writing to its own range of the arrays
+    std::vector<size_t> vertexOffsets(aiscene->mNumMeshes);
+    std::vector<size_t> triangleOffsets(aiscene->mNumMeshes);
+    auto vertexCount = geometry.m_Vertices.size();
+    auto triangleCount = geometry.m_Triangles.size();
     for (size_t meshIdx = 0u; meshIdx < aiscene->mNumMeshes; ++meshIdx) {
-        loadMesh(aiscene->mMeshes[meshIdx], materialOffset, geometry);
+        const auto * aimesh = aiscene->mMeshes[meshIdx];
+        vertexOffsets[meshIdx] = vertexCount;
+        triangleOffsets[meshIdx] = triangleCount;
+        geometry.m_Meshes.emplace_back(triangleCount, aimesh->mNumFaces, aimesh->mNumVertices);
+        vertexCount += aimesh->mNumVertices;
+        triangleCount += aimesh->mNumFaces;
     }
+    geometry.m_Vertices.resize(vertexCount);
+    geometry.m_Triangles.resize(triangleCount);
+
+    // Mesh sizes vary a lot, dynamic scheduling balances big meshes with many small ones
+    syncParallelLoop(aiscene->mNumMeshes, ParallelLoopOptions{ ParallelSchedule::Dynamic }, [&](uint32_t meshIdx, uint32_t threadId)
+    {
+        loadMesh(aiscene->mMeshes[meshIdx], materialOffset, vertexOffsets[meshIdx], triangleOffsets[meshIdx], geometry);
+    });
 }
 
 SceneGeometry loadModel(const std::string& filepath) {
+    const TraceScope trace("loadModel");
 
     Assimp::Importer importer;
 
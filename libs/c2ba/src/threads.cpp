@@ -3,4 +3,224 @@
 namespace c2ba
 {
 
-}
\ No newline at end of file
+namespace
+{
+
+thread_local const ThreadPool * t_pWorkerPool = nullptr;
+thread_local int32_t t_WorkerIndex = -1;
+
+std::unique_ptr<ThreadPool> s_pThreadPool;
+std::mutex s_ThreadPoolMutex;
+
+}
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    threadCount = std::max(1u, threadCount);
+
+    m_Workers.reserve(threadCount);
+    for (auto i = 0u; i < threadCount; ++i) {
+        m_Workers.emplace_back(std::make_unique<Worker>());
+    }
+
+    m_Threads.reserve(threadCount);
+    for (auto i = 0u; i < threadCount; ++i) {
+        m_Threads.emplace_back([this, i]() { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> l{ m_SleepMutex };
+        m_bStopped = true;
+    }
+    m_SleepCondition.notify_all();
+
+    for (auto & thread : m_Threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    const auto currentWorker = workerIndex();
+    const auto workerIdx = currentWorker >= 0 ? uint32_t(currentWorker) : m_NextWorker++ % threadCount();
+
+    {
+        auto & worker = *m_Workers[workerIdx];
+        std::unique_lock<std::mutex> l{ worker.mutex };
+        worker.tasks.emplace_back(std::move(task));
+    }
+
+    {
+        std::unique_lock<std::mutex> l{ m_SleepMutex };
+        ++m_PendingTaskCount;
+    }
+    m_SleepCondition.notify_one();
+}
+
+bool ThreadPool::runPendingTask()
+{
+    const auto currentWorker = workerIndex();
+    const auto workerIdx = currentWorker >= 0 ? uint32_t(currentWorker) : m_NextWorker % threadCount();
+
+    Task task;
+    if (!popTask(workerIdx, task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::wait(std::future<void> & future)
+{
+    if (workerIndex() < 0) {
+        future.wait();
+        return;
+    }
+
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        if (!runPendingTask()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+int32_t ThreadPool::workerIndex() const
+{
+    return t_pWorkerPool == this ? t_WorkerIndex : -1;
+}
+
+bool ThreadPool::popTask(uint32_t workerIdx, Task & task)
+{
+    {
+        auto & worker = *m_Workers[workerIdx];
+        std::unique_lock<std::mutex> l{ worker.mutex };
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            --m_PendingTaskCount;
+            return true;
+        }
+    }
+
+    // Steal from the other workers, starting with the next one to spread thieves over victims
+    for (auto i = 1u; i < threadCount(); ++i) {
+        auto & victim = *m_Workers[(workerIdx + i) % threadCount()];
+        std::unique_lock<std::mutex> l{ victim.mutex, std::try_to_lock };
+        if (l.owns_lock() && !victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --m_PendingTaskCount;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::workerLoop(uint32_t workerIdx)
+{
+    t_pWorkerPool = this;
+    t_WorkerIndex = int32_t(workerIdx);
+
+    Task task;
+    while (true)
+    {
+        if (popTask(workerIdx, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> l{ m_SleepMutex };
+        ++m_IdleThreadCount;
+        // A steal can fail on a contended try_lock while tasks are still pending, so only sleep when nothing is left
+        m_SleepCondition.wait(l, [this]() { return m_bStopped || m_PendingTaskCount > 0; });
+        --m_IdleThreadCount;
+        if (m_bStopped && m_PendingTaskCount <= 0) {
+            break;
+        }
+    }
+}
+
+namespace detail
+{
+
+ParallelLoopState::ParallelLoopState(uint32_t runCount, const ParallelLoopOptions & options):
+    runCount(runCount),
+    threadCount(std::max(1u, std::min(options.threadCount ? options.threadCount : getThreadCount(), runCount))),
+    grainSize(std::max(1u, options.grainSize)),
+    schedule(options.schedule),
+    runningThreadCount(threadCount)
+{
+}
+
+bool ParallelLoopState::nextChunk(uint32_t threadId, uint32_t & chunkIdx, uint32_t & begin, uint32_t & end)
+{
+    switch (schedule)
+    {
+    case ParallelSchedule::Static:
+    {
+        const auto chunkSize = grainSize > 1 ? grainSize : runCount / threadCount + ((runCount % threadCount) ? 1 : 0);
+        const auto chunk = uint64_t(threadId) + uint64_t(chunkIdx++) * threadCount;
+        if (chunk * chunkSize >= runCount) {
+            return false;
+        }
+        begin = uint32_t(chunk * chunkSize);
+        end = std::min(begin + chunkSize, runCount);
+        return true;
+    }
+    case ParallelSchedule::Dynamic:
+    {
+        if (nextRun >= runCount) { // Avoid to overflow the counter with threads repeatedly asking for work
+            return false;
+        }
+        begin = nextRun.fetch_add(grainSize);
+        if (begin >= runCount) {
+            return false;
+        }
+        end = std::min(begin + grainSize, runCount);
+        return true;
+    }
+    case ParallelSchedule::Guided:
+    {
+        begin = nextRun;
+        do {
+            if (begin >= runCount) {
+                return false;
+            }
+            const auto chunkSize = std::max(grainSize, (runCount - begin) / (2 * threadCount));
+            end = begin + std::min(chunkSize, runCount - begin);
+        } while (!nextRun.compare_exchange_weak(begin, end));
+        return true;
+    }
+    }
+    return false;
+}
+
+}
+
+ThreadPool & getThreadPool()
+{
+    std::unique_lock<std::mutex> l{ s_ThreadPoolMutex };
+    if (!s_pThreadPool) {
+        s_pThreadPool = std::make_unique<ThreadPool>(getDefaultThreadCount());
+    }
+    return *s_pThreadPool;
+}
+
+void setThreadCount(uint32_t threadCount)
+{
+    std::unique_lock<std::mutex> l{ s_ThreadPoolMutex };
+    s_pThreadPool.reset(); // Join the workers of the previous pool before starting the new ones
+    s_pThreadPool = std::make_unique<ThreadPool>(threadCount ? threadCount : getDefaultThreadCount());
+}
+
+int32_t getWorkerIndex()
+{
+    return t_WorkerIndex;
+}
+
+}